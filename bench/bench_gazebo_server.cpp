@@ -0,0 +1,303 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the server on the differential drive test model.
+//
+// Run with --benchmark_format=json or --benchmark_out=<file> in order to
+// get results which can be compared between releases.
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <gazebo/physics/physics.hh>
+
+#include "gazebo_server/channel_reader.h"
+#include "gazebo_server/gazebo_server.h"
+
+namespace gazebo_server {
+namespace {
+
+GazeboServer::Config GetConfig() {
+  GazeboServer::Config config;
+  const std::string test_data_path(TEST_DATA_PATH);
+  config.world_path = test_data_path + "/empty_test.world";
+  const std::string model_path =
+      test_data_path + "/differential_drive/model.sdf";
+  std::ifstream stream(model_path.c_str());
+  std::stringstream sstream;
+  sstream << stream.rdbuf();
+  config.model_sdf_xml = sstream.str();
+  return config;
+}
+
+// The server shared by all benchmarks but BM_Start. It's started lazily,
+// because BM_Start needs a process without a server to fork from.
+GazeboServer* GetServer() {
+  static std::unique_ptr<GazeboServer> server;
+  if (server == nullptr) {
+    server = std::make_unique<GazeboServer>(GetConfig());
+    if (!server->Start()) {
+      server.reset();
+      return nullptr;
+    }
+  }
+  return server.get();
+}
+
+#define GET_SERVER_OR_SKIP(state)                    \
+  GazeboServer* server = GetServer();                \
+  if (server == nullptr) {                           \
+    state.SkipWithError("Failed to start server!"); \
+    return;                                          \
+  }                                                  \
+  server->Reset()
+
+// Measures Start() in a forked child process, since a process can run only
+// one server.
+void BM_Start(benchmark::State& state) {
+  if (gazebo::physics::has_world()) {
+    state.SkipWithError("A server is running in this process already!");
+    return;
+  }
+  GazeboServer::StartupTimings timings;
+  for (auto _ : state) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      state.SkipWithError("Failed to create a pipe!");
+      return;
+    }
+    const pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      GazeboServer server(GetConfig());
+      const bool success = server.Start();
+      timings = server.startup_timings();
+      const bool written =
+          write(fds[1], &timings, sizeof(timings)) == sizeof(timings);
+      close(fds[1]);
+      _exit(success && written ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(fds[1]);
+    const bool read_ok = pid > 0 && read(fds[0], &timings, sizeof(timings)) ==
+                                        sizeof(timings);
+    close(fds[0]);
+    int status = 0;
+    if (pid > 0) waitpid(pid, &status, 0);
+    if (!read_ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      state.SkipWithError("Failed to start server in a child process!");
+      return;
+    }
+    state.SetIterationTime(
+        std::chrono::duration<double>(timings.total).count());
+  }
+  using Msec = std::chrono::duration<double, std::milli>;
+  state.counters["describe_models_ms"] = Msec(timings.describe_models).count();
+  state.counters["setup_server_ms"] = Msec(timings.setup_server).count();
+  state.counters["load_world_ms"] = Msec(timings.load_world).count();
+  state.counters["insert_model_ms"] = Msec(timings.insert_model).count();
+}
+BENCHMARK(BM_Start)->UseManualTime()->Iterations(5)->Unit(
+    benchmark::kMillisecond);
+
+void BM_Step(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  for (auto _ : state) {
+    server->Step();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Step);
+
+void BM_RunFor(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  const int num_steps = state.range(0);
+  const auto noop = []() {};
+  for (auto _ : state) {
+    server->RunFor(num_steps, noop, GazeboServer::Callback());
+  }
+  state.SetItemsProcessed(state.iterations() * num_steps);
+}
+BENCHMARK(BM_RunFor)->Arg(1)->Arg(10)->Arg(100)->Arg(1000);
+
+void BM_Reset(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  for (auto _ : state) {
+    server->Reset();
+  }
+}
+BENCHMARK(BM_Reset);
+
+void BM_ResetToInitialState(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  for (auto _ : state) {
+    server->ResetToInitialState();
+  }
+}
+BENCHMARK(BM_ResetToInitialState);
+
+void BM_SaveState(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  StateSnapshot snapshot;
+  for (auto _ : state) {
+    server->SaveState(&snapshot);
+  }
+}
+BENCHMARK(BM_SaveState);
+
+void BM_RestoreState(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  StateSnapshot snapshot;
+  server->SaveState(&snapshot);
+  for (auto _ : state) {
+    server->RestoreState(snapshot);
+  }
+}
+BENCHMARK(BM_RestoreState);
+
+void BM_GetLink(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(server->GetLink("chassis"));
+  }
+}
+BENCHMARK(BM_GetLink);
+
+void BM_GetJoint(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(server->GetJoint("left_wheel_hinge"));
+  }
+}
+BENCHMARK(BM_GetJoint);
+
+void BM_GetLinkAt(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  const int index = server->LinkIndex("chassis");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(server->GetLinkAt(index));
+  }
+}
+BENCHMARK(BM_GetLinkAt);
+
+void BM_GetJointAt(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  const int index = server->JointIndex("left_wheel_hinge");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(server->GetJointAt(index));
+  }
+}
+BENCHMARK(BM_GetJointAt);
+
+void BM_LinkGetWorldPose(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  auto link = server->GetLink("chassis");
+  Eigen::Vector3d world_p_link;
+  Eigen::Matrix3d world_r_link;
+  for (auto _ : state) {
+    link->GetWorldPose(&world_p_link, &world_r_link);
+    benchmark::DoNotOptimize(world_p_link);
+    benchmark::DoNotOptimize(world_r_link);
+  }
+}
+BENCHMARK(BM_LinkGetWorldPose);
+
+template <Eigen::Vector3d (Link::*Getter)() const>
+void BM_LinkGetter(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  auto link = server->GetLink("chassis");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(((*link).*Getter)());
+  }
+}
+BENCHMARK_TEMPLATE(BM_LinkGetter, &Link::GetWorldLinearVel);
+BENCHMARK_TEMPLATE(BM_LinkGetter, &Link::GetWorldAngularVel);
+BENCHMARK_TEMPLATE(BM_LinkGetter, &Link::GetWorldLinearAccel);
+BENCHMARK_TEMPLATE(BM_LinkGetter, &Link::GetWorldAngularAccel);
+BENCHMARK_TEMPLATE(BM_LinkGetter, &Link::GetRelativeLinearVel);
+BENCHMARK_TEMPLATE(BM_LinkGetter, &Link::GetRelativeLinearAccel);
+BENCHMARK_TEMPLATE(BM_LinkGetter, &Link::GetRelativeAngularVel);
+BENCHMARK_TEMPLATE(BM_LinkGetter, &Link::GetRelativeAngularAccel);
+
+void BM_JointGetters(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  auto joint = server->GetJoint("left_wheel_hinge");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(joint->GetPosition());
+    benchmark::DoNotOptimize(joint->GetVelocity());
+    benchmark::DoNotOptimize(joint->GetTorque());
+  }
+}
+BENCHMARK(BM_JointGetters);
+
+void BM_ReadState(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  StateBuffer buffer;
+  server->ResolveStateBuffer(
+      {"chassis", "left_wheel", "right_wheel"},
+      {"left_wheel_hinge", "right_wheel_hinge"}, &buffer);
+  for (auto _ : state) {
+    server->ReadState(&buffer);
+    benchmark::DoNotOptimize(buffer.data().data());
+  }
+}
+BENCHMARK(BM_ReadState);
+
+void BM_ChannelReader(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  StateBuffer buffer;
+  server->ResolveStateBuffer(
+      {"chassis", "left_wheel", "right_wheel"},
+      {"left_wheel_hinge", "right_wheel_hinge"}, &buffer);
+  ChannelReader<channels::WorldPose, channels::WorldLinearVel,
+                channels::JointPosition>
+      reader(buffer);
+  for (auto _ : state) {
+    reader.Read();
+    benchmark::DoNotOptimize(reader.data().data());
+  }
+}
+BENCHMARK(BM_ChannelReader);
+
+void BM_Rollout(benchmark::State& state) {
+  GET_SERVER_OR_SKIP(state);
+  CommandBuffer commands;
+  StateBuffer buffer;
+  server->ResolveCommandBuffer({"left_wheel_hinge", "right_wheel_hinge"},
+                               &commands);
+  server->ResolveStateBuffer({"chassis"}, {}, &buffer);
+  server->SetCommandBuffer(&commands);
+  server->SetStateBuffer(&buffer);
+  const int num_commands = state.range(0);
+  const Eigen::MatrixXd joint_commands =
+      Eigen::MatrixXd::Constant(num_commands, 2, 1.0);
+  Trajectory trajectory;
+  for (auto _ : state) {
+    server->Rollout(joint_commands, 1, &trajectory);
+  }
+  server->SetCommandBuffer(nullptr);
+  server->SetStateBuffer(nullptr);
+  state.SetItemsProcessed(state.iterations() * num_commands);
+}
+BENCHMARK(BM_Rollout)->Arg(100);
+
+}  // namespace
+}  // namespace gazebo_server
+
+BENCHMARK_MAIN();
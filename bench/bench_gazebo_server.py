@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+# Copyright 2019 Milan Vukov. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Benchmarks the overhead of Python bindings for Gazebo server.
+
+Prints a JSON report with the mean time per call in nanoseconds, such that
+reports of different releases can be diffed. Run from the package root.
+"""
+
+import argparse
+import json
+import os
+import timeit
+
+import numpy
+
+from gazebo_server import py_gazebo_server
+
+
+def make_server(package_path):
+  config = py_gazebo_server.GazeboServer.Config()
+  config.world_path = os.path.join(package_path, 'test_data',
+                                   'empty_test.world')
+  model_sdf_path = os.path.join(package_path, 'test_data',
+                                'differential_drive', 'model.sdf')
+  with open(model_sdf_path, 'r') as stream:
+    config.model_sdf_xml = stream.read()
+
+  server = py_gazebo_server.GazeboServer(config)
+  if not server.start():
+    raise RuntimeError('Failed to start the server!')
+  return server
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__)
+  parser.add_argument('--number', type=int, default=1000,
+                      help='The number of calls per benchmark.')
+  parser.add_argument('--output', help='Writes the report into a file.')
+  args = parser.parse_args()
+
+  server = make_server(os.getcwd())
+  chassis = server.get_link('chassis')
+  left_wheel_hinge = server.get_joint('left_wheel_hinge')
+  commands = server.resolve_command_buffer(
+      ['left_wheel_hinge', 'right_wheel_hinge'])
+  state = server.resolve_state_buffer(
+      ['chassis', 'left_wheel', 'right_wheel'],
+      ['left_wheel_hinge', 'right_wheel_hinge'])
+  joint_commands = numpy.ones((100, 2))
+
+  def noop():
+    pass
+
+  def rollout():
+    server.set_command_buffer(commands)
+    server.set_state_buffer(state)
+    server.rollout(joint_commands, 1)
+    server.set_command_buffer(None)
+    server.set_state_buffer(None)
+
+  benchmarks = {
+      'step': server.step,
+      'run_for_10_with_callbacks': lambda: server.run_for(10, noop, noop),
+      'run_for_without_gil_10': lambda: server.run_for_without_gil(10),
+      'rollout_100': rollout,
+      'reset': server.reset,
+      'reset_to_initial_state': server.reset_to_initial_state,
+      'get_link': lambda: server.get_link('chassis'),
+      'get_joint': lambda: server.get_joint('left_wheel_hinge'),
+      'link_get_world_pose': chassis.get_world_pose,
+      'link_get_world_linear_vel': chassis.get_world_linear_vel,
+      'link_get_relative_angular_accel': chassis.get_relative_angular_accel,
+      'joint_get_position': left_wheel_hinge.get_position,
+      'read_state': lambda: server.read_state(state),
+      'state_view_world_p_link': lambda: state.world_p_link,
+  }
+
+  report = {}
+  for name, function in benchmarks.items():
+    server.reset()
+    seconds = timeit.timeit(function, number=args.number)
+    report[name] = {
+        'iterations': args.number,
+        'time_per_call_ns': 1e9 * seconds / args.number,
+    }
+
+  output = json.dumps(report, indent=2, sort_keys=True)
+  if args.output:
+    with open(args.output, 'w') as stream:
+      stream.write(output)
+  print(output)
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,235 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_CHANNEL_READER_H_
+#define GAZEBO_SERVER_CHANNEL_READER_H_
+
+#include <type_traits>
+#include <vector>
+
+#include <Eigen/Core>
+#include <gazebo/physics/Joint.hh>
+#include <gazebo/physics/Link.hh>
+
+#include "gazebo_server/joint.h"
+#include "gazebo_server/state_buffer.h"
+
+namespace gazebo_server {
+
+/**
+ * Channels read by ChannelReader.
+ *
+ * A channel has a size and reads that many values of a link or of a joint
+ * axis. Vectors are stored as (x, y, z), quaternions as (x, y, z, w).
+ */
+namespace channels {
+
+namespace internal {
+
+inline void Write(const ignition::math::Vector3d& vector, double* values) {
+  values[0] = vector.X();
+  values[1] = vector.Y();
+  values[2] = vector.Z();
+}
+
+}  // namespace internal
+
+struct LinkChannel {
+  static constexpr bool kIsLinkChannel = true;
+};
+
+struct JointChannel {
+  static constexpr bool kIsLinkChannel = false;
+};
+
+// The position followed by the orientation of a link in the world frame.
+struct WorldPose : LinkChannel {
+  static constexpr int kSize = 7;
+  static void Read(gazebo::physics::Link* link, double* values) {
+    const auto world_t_link = link->WorldPose();
+    const auto& q = world_t_link.Rot();
+    internal::Write(world_t_link.Pos(), values);
+    values[3] = q.X();
+    values[4] = q.Y();
+    values[5] = q.Z();
+    values[6] = q.W();
+  }
+};
+
+#define GAZEBO_SERVER_LINK_VECTOR_CHANNEL(Name)                     \
+  struct Name : LinkChannel {                                       \
+    static constexpr int kSize = 3;                                 \
+    static void Read(gazebo::physics::Link* link, double* values) { \
+      internal::Write(link->Name(), values);                        \
+    }                                                               \
+  };
+
+GAZEBO_SERVER_LINK_VECTOR_CHANNEL(WorldLinearVel)
+GAZEBO_SERVER_LINK_VECTOR_CHANNEL(WorldAngularVel)
+GAZEBO_SERVER_LINK_VECTOR_CHANNEL(WorldLinearAccel)
+GAZEBO_SERVER_LINK_VECTOR_CHANNEL(WorldAngularAccel)
+GAZEBO_SERVER_LINK_VECTOR_CHANNEL(RelativeLinearVel)
+GAZEBO_SERVER_LINK_VECTOR_CHANNEL(RelativeAngularVel)
+GAZEBO_SERVER_LINK_VECTOR_CHANNEL(RelativeLinearAccel)
+GAZEBO_SERVER_LINK_VECTOR_CHANNEL(RelativeAngularAccel)
+
+#undef GAZEBO_SERVER_LINK_VECTOR_CHANNEL
+
+struct JointPosition : JointChannel {
+  static constexpr int kSize = 1;
+  static void Read(const JointAxis& joint_axis, double* values) {
+    values[0] = joint_axis.joint->Position(joint_axis.axis);
+  }
+};
+
+struct JointVelocity : JointChannel {
+  static constexpr int kSize = 1;
+  static void Read(const JointAxis& joint_axis, double* values) {
+    values[0] = joint_axis.joint->GetVelocity(joint_axis.axis);
+  }
+};
+
+struct JointEffort : JointChannel {
+  static constexpr int kSize = 1;
+  static void Read(const JointAxis& joint_axis, double* values) {
+    values[0] = joint_axis.joint->GetForce(joint_axis.axis);
+  }
+};
+
+}  // namespace channels
+
+/**
+ * Reads a set of channels chosen at compile time, e.g.
+ * ChannelReader<channels::WorldPose, channels::JointPosition>.
+ *
+ * Read() is a single sweep over the links and joint axes of a resolved
+ * StateBuffer. The channels of every link or joint axis are read back to
+ * back, without runtime dispatch and without unused channels. Values are
+ * written into one contiguous, aligned buffer: the link block holds one
+ * column of kLinkStateSize values per link, followed by the joint block with
+ * one column of kJointAxisStateSize values per joint axis. Within a column,
+ * channels follow the order of the template arguments.
+ *
+ * Like the link and joint accessors, Read() should be called from callbacks
+ * or while the simulation is not running.
+ */
+template <typename... Channels>
+class ChannelReader {
+ public:
+  static constexpr int kLinkStateSize =
+      (0 + ... + (Channels::kIsLinkChannel ? Channels::kSize : 0));
+  static constexpr int kJointAxisStateSize =
+      (0 + ... + (Channels::kIsLinkChannel ? 0 : Channels::kSize));
+
+  using LinkMatrix = Eigen::Matrix<double, kLinkStateSize, Eigen::Dynamic>;
+  using JointMatrix =
+      Eigen::Matrix<double, kJointAxisStateSize, Eigen::Dynamic>;
+
+  template <typename Channel>
+  using ChannelMap =
+      Eigen::Map<const Eigen::Matrix<double, Channel::kSize, Eigen::Dynamic>,
+                 Eigen::Unaligned, Eigen::OuterStride<>>;
+
+  ChannelReader() = default;
+
+  // Reads the links and joints of a buffer resolved by
+  // GazeboServer::ResolveStateBuffer().
+  explicit ChannelReader(const StateBuffer& buffer)
+      : joint_axes_(buffer.joint_axes_) {
+    for (const auto& link : buffer.links_) {
+      links_.push_back(link.get());
+    }
+    data_.setZero(kLinkStateSize * num_links() +
+                  kJointAxisStateSize * num_joint_axes());
+  }
+
+  void Read() {
+    double* values = data_.data();
+    for (auto* link : links_) {
+      (ReadLink<Channels>(link, &values), ...);
+    }
+    for (const auto& joint_axis : joint_axes_) {
+      (ReadJointAxis<Channels>(joint_axis, &values), ...);
+    }
+  }
+
+  int num_links() const { return links_.size(); }
+  int num_joint_axes() const { return joint_axes_.size(); }
+
+  Eigen::Map<const LinkMatrix> links() const {
+    return {data_.data(), kLinkStateSize, num_links()};
+  }
+  Eigen::Map<const JointMatrix> joint_axes() const {
+    return {joint_data(), kJointAxisStateSize, num_joint_axes()};
+  }
+
+  // A single channel, one column per link or joint axis.
+  template <typename Channel>
+  ChannelMap<Channel> channel() const {
+    static_assert((std::is_same_v<Channel, Channels> || ...),
+                  "The channel is not read by this reader!");
+    if constexpr (Channel::kIsLinkChannel) {
+      return {data_.data() + Offset<Channel>(), Channel::kSize, num_links(),
+              Eigen::OuterStride<>(kLinkStateSize)};
+    } else {
+      return {joint_data() + Offset<Channel>(), Channel::kSize,
+              num_joint_axes(), Eigen::OuterStride<>(kJointAxisStateSize)};
+    }
+  }
+
+  // All values, the link block followed by the joint block.
+  const Eigen::VectorXd& data() const { return data_; }
+
+ private:
+  template <typename Channel>
+  static void ReadLink(gazebo::physics::Link* link, double** values) {
+    if constexpr (Channel::kIsLinkChannel) {
+      Channel::Read(link, *values);
+      *values += Channel::kSize;
+    }
+  }
+
+  template <typename Channel>
+  static void ReadJointAxis(const JointAxis& joint_axis, double** values) {
+    if constexpr (!Channel::kIsLinkChannel) {
+      Channel::Read(joint_axis, *values);
+      *values += Channel::kSize;
+    }
+  }
+
+  // The offset of a channel within a column.
+  template <typename Channel>
+  static constexpr int Offset() {
+    int offset = 0;
+    bool found = false;
+    ((found = found || std::is_same_v<Channel, Channels>,
+      offset += !found && Channels::kIsLinkChannel == Channel::kIsLinkChannel
+                    ? Channels::kSize
+                    : 0),
+     ...);
+    return offset;
+  }
+
+  const double* joint_data() const {
+    return data_.data() + kLinkStateSize * num_links();
+  }
+
+  std::vector<gazebo::physics::Link*> links_;
+  std::vector<JointAxis> joint_axes_;
+  // Allocated by Eigen, aligned for vectorization.
+  Eigen::VectorXd data_;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_CHANNEL_READER_H_
@@ -0,0 +1,111 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_COMMAND_BUFFER_H_
+#define GAZEBO_SERVER_COMMAND_BUFFER_H_
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <gazebo/physics/PhysicsTypes.hh>
+
+#include "gazebo_server/joint.h"
+
+namespace gazebo_server {
+
+class GazeboServer;
+
+// How a command drives a joint axis. Resulting efforts are clamped to
+// [-effort_limit, effort_limit].
+enum class ControlMode {
+  // The command is the effort.
+  kEffort,
+  // The command is the position setpoint of a PD controller:
+  // effort = kp * (command - position) - kd * velocity.
+  kPosition,
+  // The command is the velocity setpoint:
+  // effort = kd * (command - velocity).
+  kVelocity,
+};
+
+/**
+ * Holds commands for a fixed set of joints.
+ *
+ * The buffer is resolved once by GazeboServer::ResolveCommandBuffer().
+ * When set by GazeboServer::SetCommandBuffer(), the commands are applied at
+ * the beginning of every world update, before any RunFor() callback is
+ * called. Every axis has its own control mode, see ControlMode, such that
+ * position and velocity controllers run at the physics rate; the buffer only
+ * has to be touched when a setpoint changes.
+ */
+class CommandBuffer {
+ public:
+  int num_joint_axes() const { return joint_axes_.size(); }
+  const std::vector<std::string>& joint_names() const { return joint_names_; }
+
+  // One command per axis of every joint, in the order of joint_names().
+  Eigen::Map<Eigen::VectorXd> command() {
+    return {command_.data(), command_.size()};
+  }
+  Eigen::Map<const Eigen::VectorXd> command() const {
+    return {command_.data(), command_.size()};
+  }
+  // The same as command(), for buffers in the effort mode.
+  Eigen::Map<Eigen::VectorXd> effort() { return command(); }
+  Eigen::Map<const Eigen::VectorXd> effort() const { return command(); }
+
+  // The modes of axes, kEffort after resolving.
+  ControlMode mode(int index) const { return modes_[index]; }
+  void set_mode(int index, ControlMode mode) { modes_[index] = mode; }
+  void set_mode(ControlMode mode) {
+    std::fill(modes_.begin(), modes_.end(), mode);
+  }
+
+  // Controller gains per axis, zero after resolving.
+  Eigen::Map<Eigen::VectorXd> kp() { return {kp_.data(), kp_.size()}; }
+  Eigen::Map<const Eigen::VectorXd> kp() const {
+    return {kp_.data(), kp_.size()};
+  }
+  Eigen::Map<Eigen::VectorXd> kd() { return {kd_.data(), kd_.size()}; }
+  Eigen::Map<const Eigen::VectorXd> kd() const {
+    return {kd_.data(), kd_.size()};
+  }
+
+  // Effort limits per axis, initialized from the model XML; infinity for
+  // axes without a limit.
+  Eigen::Map<Eigen::VectorXd> effort_limit() {
+    return {effort_limit_.data(), effort_limit_.size()};
+  }
+  Eigen::Map<const Eigen::VectorXd> effort_limit() const {
+    return {effort_limit_.data(), effort_limit_.size()};
+  }
+
+ private:
+  friend class GazeboServer;
+
+  std::vector<std::string> joint_names_;
+  std::vector<gazebo::physics::JointPtr> joints_;
+  std::vector<JointAxis> joint_axes_;
+
+  Eigen::VectorXd command_;
+  std::vector<ControlMode> modes_;
+  Eigen::VectorXd kp_;
+  Eigen::VectorXd kd_;
+  Eigen::VectorXd effort_limit_;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_COMMAND_BUFFER_H_
@@ -0,0 +1,68 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_FUNCTION_REF_H_
+#define GAZEBO_SERVER_FUNCTION_REF_H_
+
+#include <type_traits>
+
+namespace gazebo_server {
+
+/**
+ * A non-owning reference to a callable with the signature void().
+ *
+ * Unlike std::function, it never allocates and a call is a single indirect
+ * function call. The referenced callable must outlive the reference, which
+ * is why only lvalues bind to it: a temporary lambda would dangle as soon as
+ * the full expression ends. Functions, and temporary captureless lambdas
+ * which convert to function pointers, are stored by value and have no
+ * lifetime requirements.
+ */
+class FunctionRef {
+ public:
+  FunctionRef() = default;
+
+  template <typename F,
+            typename = std::enable_if_t<
+                !std::is_same<std::remove_const_t<F>, FunctionRef>::value &&
+                !std::is_function<F>::value>>
+  FunctionRef(F& callable)  // NOLINT(runtime/explicit)
+      : call_([](Target target) { (*static_cast<F*>(target.object))(); }) {
+    target_.object = const_cast<void*>(static_cast<const void*>(&callable));
+  }
+
+  FunctionRef(void (*function)())  // NOLINT(runtime/explicit)
+      : call_(function != nullptr
+                  ? +[](Target target) { target.function(); }
+                  : nullptr) {
+    target_.function = function;
+  }
+
+  void operator()() const { call_(target_); }
+
+  explicit operator bool() const { return call_ != nullptr; }
+
+ private:
+  // Function pointers don't convert to void*.
+  union Target {
+    void* object;
+    void (*function)();
+  };
+
+  Target target_ = {nullptr};
+  void (*call_)(Target) = nullptr;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_FUNCTION_REF_H_
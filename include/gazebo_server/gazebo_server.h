@@ -14,23 +14,91 @@
 #ifndef GAZEBO_SERVER_GAZEBO_SERVER_H_
 #define GAZEBO_SERVER_GAZEBO_SERVER_H_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <Eigen/Core>
 #include <gazebo/common/CommonTypes.hh>
 #include <gazebo/physics/PhysicsTypes.hh>
+#include <ignition/math/Pose3.hh>
 
+#include "gazebo_server/command_buffer.h"
+#include "gazebo_server/function_ref.h"
 #include "gazebo_server/joint.h"
 #include "gazebo_server/link.h"
+#include "gazebo_server/lockstep_pacer.h"
+#include "gazebo_server/state_buffer.h"
+#include "gazebo_server/state_publisher.h"
+#include "gazebo_server/state_snapshot.h"
+#include "gazebo_server/step_statistics.h"
 #include "gazebo_server/time.h"
+#include "gazebo_server/trajectory.h"
+#include "gazebo_server/trajectory_recorder.h"
 
 namespace gazebo_server {
 
+class GazeboServer;
+
+/**
+ * The result of GazeboServer::StepAsync().
+ *
+ * The state read by the simulation thread is copied into the state buffer of
+ * the server by get(), on the calling thread, such that the state buffer may
+ * be read while the simulation is stepping. A future is valid as long as
+ * the server which created it.
+ */
+class StepFuture {
+ public:
+  StepFuture() = default;
+
+  bool valid() const { return future_.valid(); }
+  void wait() const { future_.wait(); }
+  template <typename Rep, typename Period>
+  std::future_status wait_for(
+      const std::chrono::duration<Rep, Period>& timeout) const {
+    return future_.wait_for(timeout);
+  }
+
+  // Waits for the steps and returns true on success. May be called
+  // repeatedly.
+  bool get() const;
+
+ private:
+  friend class GazeboServer;
+
+  StepFuture(GazeboServer* server, std::future<bool> future)
+      : server_(server), future_(future.share()) {}
+
+  GazeboServer* server_ = nullptr;
+  std::shared_future<bool> future_;
+};
+
 class GazeboServer {
  public:
+  // An additional robot, see Config::additional_models.
+  struct ModelConfig {
+    ModelConfig();
+
+    // A SDF or URDF XML.
+    std::string sdf_xml;
+    // Overrides the model name in the XML if not empty. Every robot in
+    // the world must have a unique name.
+    std::string name;
+
+    Eigen::Vector3d init_world_p_body;
+    Eigen::Vector3d init_world_rpy_body;
+  };
+
   struct Config {
     static constexpr double kAsFastAsPossible = 0.0;
 
@@ -40,7 +108,11 @@ class GazeboServer {
     std::vector<std::string> model_paths;
 
     std::string world_path = "worlds/empty.world";
+    // A SDF or URDF XML of the robot.
     std::string model_sdf_xml;
+    // If not empty, model XMLs are converted and validated once and the
+    // results are kept in this directory, see ModelCache.
+    std::string model_cache_path;
 
     // Initial position, overrides the value in the model XML file.
     Eigen::Vector3d init_world_p_body;
@@ -48,22 +120,90 @@ class GazeboServer {
     // overrides the value in the model XML file.
     Eigen::Vector3d init_world_rpy_body;
 
+    // Robots inserted into the same world after the robot of model_sdf_xml.
+    // Their links and joints are referred to by names scoped with the robot
+    // name, e.g. "robot::link"; unscoped names refer to the first robot.
+    std::vector<ModelConfig> additional_models;
+
     // Turn on to get verbose output from the server. Very useful for debugging.
     bool verbose = false;
     // The seed used for noise generation.
     int seed = 918273645;
+    // Turn off for a kinematic-only mode: stepping advances the simulation
+    // time and calls callbacks, but doesn't run dynamics. Poses are set by
+    // SetRobotPose(), Link::SetWorldPose() and Joint::SetPosition().
     bool enable_physics_engine = true;
 
     // Overrides the XML value if >= 0.
     double real_time_update_rate = kAsFastAsPossible;
 
+    // If > 0, paces the simulation in lockstep with the steady clock, such
+    // that the simulation time advances this many times faster than the
+    // wall-clock time, see LockstepPacer. Pacing starts with the first
+    // stepping call after Start(), Reset() or RestoreState(), see
+    // ResumePacing(). Requires real_time_update_rate to be kAsFastAsPossible.
+    double lockstep_real_time_factor = 0.0;
+    // Pacing sleeps end this long before a deadline, the rest is busy-waited.
+    SteadyClock::duration lockstep_spin_duration =
+        std::chrono::microseconds(200);
+    // Pacing re-anchors when a step is late by more than this.
+    SteadyClock::duration lockstep_max_lag = std::chrono::milliseconds(10);
+
+    // Turn on to make Reset() call ResetToInitialState(), which is much
+    // cheaper than resetting the whole world. Requires the ODE physics engine.
+    bool fast_reset = false;
+
+    // Turn on to collect timings of world updates, see step_statistics().
+    bool collect_step_statistics = false;
+
     // Returns true if configuration is valid, false otherwise.
     bool Validate() const;
   };
 
+  // Per-episode overrides applied by Reset(). Unset values keep the values
+  // of Config, physical parameters which are not overridden are reset to
+  // their nominal values from the model XML.
+  struct ResetOptions {
+    // Overrides Config::init_world_p_body.
+    std::optional<Eigen::Vector3d> init_world_p_body;
+    // Overrides Config::init_world_rpy_body.
+    std::optional<Eigen::Vector3d> init_world_rpy_body;
+    // Overrides Config::seed.
+    std::optional<int> seed;
+
+    // Initial positions and velocities of the 0-th joint axes, by joint name.
+    std::map<std::string, double> joint_positions;
+    std::map<std::string, double> joint_velocities;
+
+    // Link masses by link name. The inertia matrices are kept.
+    std::map<std::string, double> link_masses;
+    // Friction coefficients (mu and mu2) of all collisions of a link, by link
+    // name.
+    std::map<std::string, double> link_frictions;
+  };
+
+  // Wall-clock durations of the phases of Start().
+  struct StartupTimings {
+    SteadyClock::duration describe_models{0};
+    SteadyClock::duration setup_server{0};
+    SteadyClock::duration load_world{0};
+    SteadyClock::duration insert_model{0};
+    SteadyClock::duration total{0};
+    // The number of world steps executed until the model got inserted.
+    int num_insertion_steps = 0;
+  };
+
   using Callback = std::function<void()>;
 
-  explicit GazeboServer(const Config& config) : config_(config) {}
+  enum class HookPoint {
+    kWorldUpdateBegin,
+    kWorldUpdateEnd,
+  };
+
+  explicit GazeboServer(const Config& config)
+      : config_(config),
+        pacer_(config.lockstep_real_time_factor, config.lockstep_spin_duration,
+               config.lockstep_max_lag) {}
   virtual ~GazeboServer();
 
   /**
@@ -98,13 +238,202 @@ class GazeboServer {
   bool RunFor(int num_steps, Callback on_world_update_begin,
               Callback on_world_update_end);
 
+  /**
+   * Executes a number of simulation steps with callbacks at a lower rate.
+   *
+   * The steps are divided into control periods of a number of steps. The
+   * begin callback is called at the beginning of the first world update of
+   * every period, the end callback at the end of the last one. The command
+   * buffer is applied at the beginning of every world update, before the
+   * begin callback, so commands set by the end callback of a period are
+   * held over all steps of the next period (zero-order hold). Position and
+   * velocity controllers of the command buffer keep running at the physics
+   * rate. This is a blocking function call.
+   *
+   * @param num_steps The number of simulation steps to execute. Must be
+   *                  larger than zero.
+   * @param decimation The number of simulation steps per control period.
+   *                   Must be larger than zero.
+   * @param on_control_begin This is a mandatory callback called at the
+   *        beginning of every control period.
+   * @param on_control_end This is an optional callback called at the end of
+   *        every control period.
+   *
+   * @returns True on success, false otherwise. Fails if the simulator is
+   *          not initialized, or if the arguments are invalid.
+   */
+  bool RunFor(int num_steps, int decimation, Callback on_control_begin,
+              Callback on_control_end);
+
+  /**
+   * Executes a number of simulation steps on a dedicated simulation thread.
+   *
+   * The commands of the command buffer are copied on submission and applied
+   * during all steps, such that the next command can be computed while
+   * the simulation is stepping. The state buffer, if set, is not touched by
+   * the simulation thread; it's updated by StepFuture::get(), or by the next
+   * StepAsync() call, on the calling thread. Hooks are called from
+   * the simulation thread.
+   *
+   * Until the future becomes ready, the server is not ready: stepping,
+   * resetting, saving and restoring fail, and so does setting buffers and
+   * hooks. Link and joint accessors must not be used in the meantime.
+   *
+   * @param num_steps The number of simulation steps to execute. Must be
+   *                  larger than zero.
+   *
+   * @returns A future which becomes true once the steps are done, or false
+   *          if the simulator is not ready or the argument is invalid.
+   */
+  StepFuture StepAsync(int num_steps = 1);
+
+  /**
+   * Runs an open-loop command sequence and records the resulting states.
+   *
+   * The command buffer and the state buffer set on the server define
+   * the commanded joints and the recorded state. Every command is held for
+   * a number of simulation steps, after which the state is recorded.
+   * This is a blocking function call.
+   *
+   * @param joint_commands The commands, one row per command, one column
+   *                       per axis of the command buffer, interpreted
+   *                       according to the control modes of the buffer.
+   * @param steps_per_command The number of simulation steps each command
+   *                          is held for. Must be larger than zero.
+   * @param out The output trajectory with one state per command.
+   *
+   * @returns True on success, false otherwise. Fails if the simulator is not
+   *          initialized, if no command or state buffer is set, or if the
+   *          arguments are invalid.
+   */
+  bool Rollout(const Eigen::MatrixXd& joint_commands, int steps_per_command,
+               Trajectory* out);
+
+  /**
+   * Registers a hook called at every world update.
+   *
+   * Hooks stay registered across Step(), RunFor() and Rollout() calls.
+   * Begin hooks are called after the command buffer is applied and before
+   * the RunFor() begin callback; end hooks are called after the state buffer
+   * is refreshed and before the RunFor() end callback. Hooks must not add or
+   * remove hooks.
+   *
+   * @param point Where the hook is called.
+   * @param hook The callable. The server doesn't own it; it must stay alive
+   *             until the hook is removed or the server is destroyed.
+   *
+   * @returns The hook id on success, -1 if the simulator is not initialized
+   *          or the hook is empty.
+   */
+  int AddHook(HookPoint point, FunctionRef hook);
+
+  /**
+   * Removes a hook registered by AddHook().
+   *
+   * @returns True on success, false if the id is unknown.
+   */
+  bool RemoveHook(int hook_id);
+
+  /**
+   * Ends the running Step(), RunFor(), StepAsync() or Rollout() call after
+   * the current world update; the remaining steps are skipped.
+   *
+   * Must only be called from callbacks and hooks. Rollout() fails if it's
+   * ended early.
+   */
+  void EndRun();
+
   /**
    * Resets the simulator.
    *
+   * Calls ResetToInitialState() if Config::fast_reset is set, resets
+   * the whole world otherwise.
+   *
    * True on success, false if the simulator is not initialized.
    */
   bool Reset();
 
+  /**
+   * Resets the simulator with per-episode overrides.
+   *
+   * The overrides are applied in place, such that randomized episodes don't
+   * require a new server. With Config::fast_reset, the robot is reset to
+   * the initial state and then moved to the overridden pose.
+   *
+   * @param options The overrides.
+   *
+   * @returns True on success, false if the simulator is not initialized,
+   *          if a link or a joint name is invalid, if a joint has no axis or
+   *          if a value is not positive where it has to be. Nothing is
+   *          changed on failure.
+   */
+  bool Reset(const ResetOptions& options);
+
+  /**
+   * Resets the robot to the state captured at the end of Start().
+   *
+   * Restores only the physics state of the robot links, the simulation time
+   * and the random number generator, see RestoreState(). Unlike Reset(),
+   * it doesn't reset other models, plugins or the iteration count of
+   * the world. The simulation continues identically after every reset.
+   *
+   * Requires the ODE physics engine.
+   *
+   * @returns True on success, false if the simulator is not ready.
+   */
+  bool ResetToInitialState();
+
+  /**
+   * Sets the pose of the robot kinematically.
+   *
+   * Velocities are kept. Together with Joint::SetPosition(), this allows
+   * replaying logged trajectories with the physics engine disabled.
+   *
+   * @param world_p_body The position of the robot.
+   * @param world_r_body The orientation of the robot.
+   *
+   * @returns True on success, false if the simulator is not ready.
+   */
+  bool SetRobotPose(const Eigen::Vector3d& world_p_body,
+                    const Eigen::Matrix3d& world_r_body);
+
+  /**
+   * Sets the pose of a robot kinematically, see SetRobotPose().
+   *
+   * @returns True on success, false if the simulator is not ready or
+   *          the robot name is invalid.
+   */
+  bool SetRobotPose(const std::string& robot_name,
+                    const Eigen::Vector3d& world_p_body,
+                    const Eigen::Matrix3d& world_r_body);
+
+  /**
+   * Saves the simulation state into a snapshot.
+   *
+   * The snapshot holds the raw physics state of all links of the robot model,
+   * the simulation time and the state of the random number generator.
+   * Saving doesn't change the simulation. After every restore of
+   * the snapshot, the simulation continues exactly as it did after saving,
+   * random numbers included.
+   *
+   * Requires the ODE physics engine.
+   *
+   * @param snapshot The output snapshot. Its memory is reused.
+   *
+   * @returns True on success, false otherwise.
+   */
+  bool SaveState(StateSnapshot* snapshot);
+
+  /**
+   * Restores the simulation state from a snapshot.
+   *
+   * @param snapshot A snapshot saved by this server.
+   *
+   * @returns True on success, false if the simulator is not initialized or
+   *          the snapshot doesn't match the robot model.
+   */
+  bool RestoreState(const StateSnapshot& snapshot);
+
   /**
    * Gets the simulation time.
    *
@@ -115,7 +444,8 @@ class GazeboServer {
   /**
    * Gets the joint accessor.
    *
-   * @param name The joint name.
+   * @param name The joint name, scoped with the robot name for robots other
+   *             than the first one.
    *
    * @returns The joint accessor on success,
    *          nullptr if the joint name is invalid.
@@ -125,16 +455,204 @@ class GazeboServer {
   /**
    * Gets the link accessor.
    *
-   * @param name The link name.
+   * @param name The link name, scoped with the robot name for robots other
+   *             than the first one.
    *
    * @returns The link accessor on success,
    *          nullptr if the link name is invalid.
    */
   std::unique_ptr<Link> GetLink(const std::string& name) const;
 
+  /**
+   * Resolves the index of a link for GetLinkAt().
+   *
+   * Indices are resolved once, after Start(). They stay valid for the lifetime
+   * of the server, also across Reset(), since models are inserted only by
+   * Start().
+   *
+   * @param name The link name, scoped as for GetLink().
+   *
+   * @returns The index of the link on success, -1 if the name is invalid.
+   */
+  int LinkIndex(const std::string& name) const;
+
+  // Resolves the index of a joint for GetJointAt(), see LinkIndex().
+  int JointIndex(const std::string& name) const;
+
+  // Gets a view of the link with the given index, without a name lookup or
+  // an allocation. The index must be valid.
+  Link GetLinkAt(int index) const;
+  // Gets a view of the joint with the given index, see GetLinkAt().
+  Joint GetJointAt(int index) const;
+
+  // The names of links and joints of all robots, by index. Names of robots
+  // other than the first one are scoped.
+  const std::vector<std::string>& link_names() const { return link_names_; }
+  const std::vector<std::string>& joint_names() const { return joint_names_; }
+
+  /**
+   * Resolves a state buffer for a set of links and joints.
+   *
+   * @param link_names The names of links to read.
+   * @param joint_names The names of joints to read. All axes of a joint
+   *                    are read.
+   * @param buffer The buffer to resolve.
+   *
+   * @returns True on success, false if the simulator is not initialized,
+   *          if a link or a joint name is invalid or if a joint has no axis.
+   */
+  bool ResolveStateBuffer(const std::vector<std::string>& link_names,
+                          const std::vector<std::string>& joint_names,
+                          StateBuffer* buffer) const;
+
+  /**
+   * Reads the state of the resolved links and joints in one pass.
+   *
+   * Doesn't allocate memory and may be called from callbacks.
+   *
+   * @param buffer The buffer resolved by ResolveStateBuffer().
+   *
+   * @returns True on success, false if the simulator is not initialized.
+   */
+  bool ReadState(StateBuffer* buffer) const;
+
+  /**
+   * Sets the state buffer refreshed at the end of every world update.
+   *
+   * The buffer is also refreshed right away and after every reset or state
+   * restore. The server doesn't own the buffer; it must stay alive until
+   * it's replaced or the server is destroyed.
+   *
+   * @param buffer A buffer resolved by ResolveStateBuffer(), or nullptr
+   *               to stop refreshing.
+   *
+   * @returns True on success, false if the simulator is not initialized.
+   */
+  bool SetStateBuffer(StateBuffer* buffer);
+
+  /**
+   * Starts publishing the state of a set of links and joints to shared
+   * memory, see StatePublisher.
+   *
+   * The state is published whenever the state buffer is refreshed, see
+   * SetStateBuffer(). Other processes read it with StateSubscriber.
+   *
+   * @param name The name of the shared memory object, e.g. "/robot_state".
+   * @param link_names The names of links to publish.
+   * @param joint_names The names of joints to publish.
+   * @param num_slots The number of states kept in shared memory.
+   *
+   * @returns True on success, false if the simulator is not initialized,
+   *          a name is invalid or the shared memory can't be created.
+   */
+  bool OpenStatePublisher(const std::string& name,
+                          const std::vector<std::string>& link_names,
+                          const std::vector<std::string>& joint_names,
+                          int num_slots = 64);
+
+  // Stops publishing and removes the shared memory object.
+  bool CloseStatePublisher();
+
+  /**
+   * Starts recording the state of a set of links and joints to a file, see
+   * TrajectoryRecorder.
+   *
+   * The current state is recorded right away, then the state after every
+   * decimation-th step. The first column holds the simulation time in
+   * seconds, the other ones the channels of StateBuffer::data(), named e.g.
+   * "chassis/world_p_link/x" or "left_wheel_hinge/joint_position". Recording
+   * stops once the file is full.
+   *
+   * @param path The path of the file, an existing file is replaced.
+   * @param link_names The names of links to record.
+   * @param joint_names The names of joints to record.
+   * @param max_num_samples The capacity of the file.
+   * @param decimation Record every decimation-th step, larger than zero.
+   *
+   * @returns True on success, false otherwise.
+   */
+  bool StartRecording(const std::string& path,
+                      const std::vector<std::string>& link_names,
+                      const std::vector<std::string>& joint_names,
+                      std::uint64_t max_num_samples, int decimation = 1);
+
+  // Flushes the recorded states and closes the file.
+  bool StopRecording();
+
+  const TrajectoryRecorder& recorder() const { return recorder_; }
+
+  /**
+   * Resolves a command buffer for a set of joints.
+   *
+   * @param joint_names The names of joints to command. All axes of a joint
+   *                    are commanded.
+   * @param buffer The buffer to resolve. All axes are in the effort mode
+   *               with zero commands.
+   *
+   * @returns True on success, false if the simulator is not initialized,
+   *          if a joint name is invalid or if a joint has no axis.
+   */
+  bool ResolveCommandBuffer(const std::vector<std::string>& joint_names,
+                            CommandBuffer* buffer) const;
+
+  /**
+   * Sets the command buffer applied at the beginning of every world update.
+   *
+   * The server doesn't own the buffer; it must stay alive until it's
+   * replaced or the server is destroyed.
+   *
+   * @param buffer A buffer resolved by ResolveCommandBuffer(), or nullptr
+   *               to stop applying commands.
+   *
+   * @returns True on success, false if the simulator is not initialized.
+   */
+  bool SetCommandBuffer(const CommandBuffer* buffer);
+
+  /**
+   * Clears the step statistics.
+   *
+   * Must not be called while the simulation is stepping.
+   */
+  void ClearStepStatistics() { step_statistics_.Clear(); }
+
+  /**
+   * Gets the timings of world updates.
+   *
+   * The statistics are collected only if Config::collect_step_statistics is
+   * set. They may be read from any thread, also while the simulation is
+   * stepping.
+   */
+  const StepStatistics& step_statistics() const { return step_statistics_; }
+
+  /**
+   * Gets the statistics of lockstep pacing.
+   *
+   * The statistics are collected only if Config::lockstep_real_time_factor
+   * is set. They may be read from any thread.
+   */
+  const PacingStatistics& pacing_statistics() const {
+    return pacer_.statistics();
+  }
+  void ClearPacingStatistics() { pacer_.ClearStatistics(); }
+
+  /**
+   * Makes the next stepping call start pacing anew.
+   *
+   * Deadlines are absolute across Step() and RunFor() calls, such that the
+   * time spent between calls is caught up. After a deliberate pause, e.g.
+   * when the control loop is suspended, call this function to avoid
+   * overruns. Reset() and RestoreState() do so implicitly.
+   *
+   * @returns True on success, false if the simulator is not ready.
+   */
+  bool ResumePacing();
+
   const Config& config() const { return config_; }
   bool initialized() const { return initialized_; }
   const std::string& robot_name() const { return robot_name_; }
+  // The names of all robots, the first one being robot_name().
+  const std::vector<std::string>& robot_names() const { return robot_names_; }
+  const StartupTimings& startup_timings() const { return startup_timings_; }
 
  protected:
   gazebo::physics::ModelPtr model_;
@@ -142,11 +660,130 @@ class GazeboServer {
 
  private:
   bool IsReady() const;
+  bool IsBusy() const;
+  bool HasOdePhysics() const;
+  bool DescribeModels(std::vector<std::string>* model_sdf_xmls);
+  std::vector<std::string> GetChannelNames(const StateBuffer& buffer) const;
+  void RecordState();
+  bool InsertModels(const std::vector<std::string>& model_sdf_xmls);
+  gazebo::physics::ModelPtr FindRobot(const std::string& scoped_name,
+                                      std::string* name) const;
+  gazebo::physics::LinkPtr FindLink(const std::string& name) const;
+  gazebo::physics::JointPtr FindJoint(const std::string& name) const;
+  ignition::math::Pose3d GetInitialPose(std::size_t robot) const;
+  bool ResolveJoints(const std::vector<std::string>& joint_names,
+                     std::vector<gazebo::physics::JointPtr>* joints,
+                     std::vector<JointAxis>* joint_axes) const;
+  // Applies commands of a buffer, reading the command of the i-th axis from
+  // command[i * stride].
+  void ApplyCommands(const CommandBuffer& buffer, const double* command,
+                     Eigen::Index stride);
+  void OnWorldUpdateBegin();
+  void OnBeforePhysicsUpdate();
+  void OnWorldUpdateEnd();
+  void AnchorPacer();
+  void RefreshStateBuffer();
+  void RunSimulationThread();
+  // Copies the state read by the simulation thread into the state buffer,
+  // if the steps are done and the state has not been copied yet.
+  void CollectAsyncState();
+  bool ValidateResetOptions(const ResetOptions& options) const;
+  void CaptureNominalLinkParameters();
+  void ApplyLinkParameters(const ResetOptions& options);
+  void ApplyJointStates(const ResetOptions& options);
+  void CaptureState(StateSnapshot* snapshot) const;
+  void ApplyState(const StateSnapshot& snapshot);
   void ShutDown();
 
+  friend class StepFuture;
+
   const Config config_;
   bool initialized_ = false;
   std::string robot_name_;
+  // The robots of Config::model_sdf_xml and Config::additional_models, and
+  // all their links and joints, indexed by LinkIndex() and JointIndex().
+  std::vector<std::string> robot_names_;
+  std::vector<gazebo::physics::ModelPtr> models_;
+  std::vector<gazebo::physics::LinkPtr> robot_links_;
+  std::vector<gazebo::physics::JointPtr> robot_joints_;
+  std::vector<std::string> link_names_;
+  std::vector<std::string> joint_names_;
+  StartupTimings startup_timings_;
+  // Captured at the end of Start() for ResetToInitialState().
+  StateSnapshot initial_state_;
+
+  // Physical parameters from the model XML, one entry per robot link.
+  struct LinkParameters {
+    double mass;
+    // The mu and mu2 friction coefficients, one pair per collision.
+    std::vector<std::pair<double, double>> frictions;
+  };
+  std::vector<LinkParameters> nominal_link_parameters_;
+  bool link_parameters_overridden_ = false;
+
+  gazebo::event::ConnectionPtr world_update_begin_;
+  gazebo::event::ConnectionPtr world_update_end_;
+  const CommandBuffer* command_buffer_ = nullptr;
+  StateBuffer* state_buffer_ = nullptr;
+  StatePublisher state_publisher_;
+  StateBuffer state_publisher_buffer_;
+
+  TrajectoryRecorder recorder_;
+  StateBuffer recorder_buffer_;
+  Eigen::VectorXd recorder_row_;
+  int recorder_decimation_ = 1;
+  int recorder_step_ = 0;
+
+  struct RolloutProgress {
+    const Eigen::MatrixXd* joint_commands;
+    int steps_per_command;
+    int step;
+    Trajectory* out;
+  };
+  RolloutProgress* rollout_ = nullptr;
+
+  struct Hook {
+    int id;
+    FunctionRef function;
+  };
+  std::vector<Hook> world_update_begin_hooks_;
+  std::vector<Hook> world_update_end_hooks_;
+  int next_hook_id_ = 0;
+
+  const Callback* run_for_begin_ = nullptr;
+  const Callback* run_for_end_ = nullptr;
+  // The RunFor() callbacks are called every run_for_decimation_-th step,
+  // counted by run_for_step_.
+  int run_for_decimation_ = 1;
+  int run_for_step_ = 0;
+
+  // StepAsync() state. While busy_ is set, only the simulation thread
+  // touches the simulation. The simulation thread applies
+  // async_command_buffer_, a copy of the command buffer, and reads the state
+  // into async_state_buffer_. Once the steps are done, it sets
+  // async_state_pending_ and the calling thread copies async_state_buffer_
+  // into state_buffer_, see CollectAsyncState().
+  std::thread simulation_thread_;
+  std::mutex async_mutex_;
+  std::condition_variable async_condition_;
+  std::promise<bool> async_promise_;
+  int async_num_steps_ = 0;
+  bool stop_simulation_thread_ = false;
+  std::atomic<bool> busy_{false};
+  bool stepping_async_ = false;
+  bool async_state_pending_ = false;
+  CommandBuffer async_command_buffer_;
+  StateBuffer async_state_buffer_;
+
+  LockstepPacer pacer_;
+  // Set when the simulation time restarts, the next stepping call anchors
+  // the pacer.
+  bool anchor_pacer_ = true;
+
+  gazebo::event::ConnectionPtr before_physics_update_;
+  StepStatistics step_statistics_;
+  SteadyTimestamp step_begin_time_;
+  SteadyTimestamp phase_end_time_;
 };
 
 }  // namespace gazebo_server
@@ -0,0 +1,263 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_GAZEBO_SERVER_POOL_H_
+#define GAZEBO_SERVER_GAZEBO_SERVER_POOL_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "gazebo_server/gazebo_server.h"
+
+namespace gazebo_server {
+
+/**
+ * An episode evaluated by GazeboServerPool::Evaluate().
+ *
+ * The server is reset with the initial pose and the seed before the episode.
+ */
+struct EpisodeSpec {
+  Eigen::Vector3d init_world_p_body = Eigen::Vector3d::Zero();
+  Eigen::Vector3d init_world_rpy_body = Eigen::Vector3d::Zero();
+  int seed = 918273645;
+
+  // The maximum number of steps, larger than zero. The controller may end
+  // the episode earlier.
+  int max_num_steps = 1;
+  // Parameters of the controller, GazeboServerPool::Config::num_episode_params
+  // values.
+  Eigen::VectorXd params;
+
+  // If not empty, the state of the links and joints of the pool
+  // configuration is recorded into this file, see
+  // GazeboServer::StartRecording().
+  std::string trajectory_path;
+};
+
+/**
+ * The outcome of an episode.
+ */
+struct EpisodeResult {
+  // The index of the episode in the evaluated specs.
+  int episode = -1;
+  // The worker which ran the episode.
+  int worker = -1;
+  bool success = false;
+  // The number of executed steps.
+  int num_steps = 0;
+  // The state at the end of the episode, a row of GazeboServerPool::states().
+  Eigen::VectorXd final_state;
+  // GazeboServerPool::Config::episode_summary_size values written by
+  // EpisodeController::EndEpisode().
+  Eigen::VectorXd summary;
+};
+
+/**
+ * Controls the robot during episodes, runs in a worker process.
+ */
+class EpisodeController {
+ public:
+  virtual ~EpisodeController() = default;
+
+  /**
+   * Prepares an episode, called after the server has been reset.
+   *
+   * @returns True on success, false to fail the episode.
+   */
+  virtual bool BeginEpisode(const EpisodeSpec& spec) = 0;
+
+  /**
+   * Sets the commands of the next step.
+   *
+   * Called after BeginEpisode() and after every step unless the episode is
+   * done. The commands are held until the next call.
+   *
+   * @param commands The command buffer of the joints in
+   *                 GazeboServerPool::Config::joint_names, with zero efforts
+   *                 at the beginning of an episode.
+   */
+  virtual void Control(CommandBuffer* /*commands*/) {}
+
+  // Called after every step, returns true to end the episode early.
+  virtual bool IsDone() { return false; }
+
+  // Writes episode_summary_size values, e.g. the return of the episode.
+  virtual void EndEpisode(double* /*summary*/) {}
+};
+
+/**
+ * Runs a number of Gazebo servers, each in its own worker process.
+ *
+ * Gazebo allows only one world per process. The pool forks the workers on
+ * Start() and drives them in lockstep: every call to Step(), RunFor() or
+ * Reset() is broadcast to all workers and returns when all of them are done.
+ * Joint torques and the robot state are exchanged through shared memory.
+ * Alternatively, Evaluate() runs independent episodes on the workers.
+ *
+ * The pool must be started from a process which doesn't run a Gazebo server.
+ */
+class GazeboServerPool {
+ public:
+  using Matrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic,
+                               Eigen::RowMajor>;
+
+  struct Config {
+    // The configuration used by all workers.
+    GazeboServer::Config server_config;
+
+    int num_workers = 1;
+
+    // The joints whose torques are set from commands(). A torque is held
+    // over all steps of a Step() or RunFor() call. Only joints with a single
+    // axis are supported.
+    std::vector<std::string> joint_names;
+    // The links whose state is written to states().
+    std::vector<std::string> link_names;
+
+    // Every worker runs its own Gazebo master; the worker with index i
+    // listens at base_master_port + i.
+    int base_master_port = 11345;
+
+    // Creates the episode controller of a worker after its server has
+    // started. Without a factory, episodes run without any commands.
+    std::function<std::unique_ptr<EpisodeController>(GazeboServer* server)>
+        episode_controller_factory;
+    // The sizes of EpisodeSpec::params and EpisodeResult::summary.
+    int num_episode_params = 0;
+    int episode_summary_size = 0;
+
+    // Returns true if configuration is valid, false otherwise.
+    bool Validate() const;
+  };
+
+  // Per-link layout of a row of states(): world_p_link (3), world_q_link
+  // as (x, y, z, w) (4), world linear (3) and angular (3) velocity.
+  static constexpr int kLinkStateSize = 13;
+  // Per-joint layout of a row of states(): position (1), velocity (1).
+  static constexpr int kJointStateSize = 2;
+
+  explicit GazeboServerPool(const Config& config);
+  virtual ~GazeboServerPool();
+
+  GazeboServerPool(const GazeboServerPool&) = delete;
+  GazeboServerPool& operator=(const GazeboServerPool&) = delete;
+
+  /**
+   * Forks the workers and starts a server in each of them.
+   *
+   * @returns True if all workers started successfully, false otherwise.
+   */
+  bool Start();
+
+  /**
+   * Executes a single simulation step on all workers.
+   *
+   * @returns True on success, false otherwise.
+   */
+  bool Step();
+
+  /**
+   * Executes a number of simulation steps on all workers.
+   *
+   * This is a blocking function call.
+   *
+   * @param num_steps The number of simulation steps to execute. Must be
+   *                  larger than zero.
+   *
+   * @returns True on success, false otherwise.
+   */
+  bool RunFor(int num_steps);
+
+  /**
+   * Resets the simulators of all workers.
+   *
+   * @returns True on success, false otherwise.
+   */
+  bool Reset();
+
+  using EpisodeCallback = std::function<void(const EpisodeResult& result)>;
+
+  /**
+   * Evaluates a number of independent episodes on all workers.
+   *
+   * Every worker takes the next pending episode as soon as it is done with
+   * its current one, so workers don't idle while others run long episodes.
+   * Results are reported in the order in which episodes finish.
+   *
+   * This is a blocking function call. commands() are not applied and
+   * states() are overwritten by the final states of episodes.
+   *
+   * @param specs The episodes.
+   * @param on_result Called in the calling process for every finished
+   *                  episode, also for failed ones.
+   *
+   * @returns True if all episodes succeeded, false otherwise.
+   */
+  bool Evaluate(const std::vector<EpisodeSpec>& specs,
+                const EpisodeCallback& on_result);
+
+  /**
+   * Joint torques, one row per worker, one column per joint in
+   * Config::joint_names. Backed by shared memory.
+   */
+  Eigen::Map<Matrix> commands();
+
+  /**
+   * Robot states, one row per worker. A row holds the simulation time in
+   * seconds followed by the link states and the joint states, see
+   * kLinkStateSize and kJointStateSize. Backed by shared memory.
+   */
+  Eigen::Map<const Matrix> states() const;
+
+  int state_size() const;
+
+  const Config& config() const { return config_; }
+  bool initialized() const { return initialized_; }
+
+ private:
+  enum class Request : int;
+
+  struct WorkerSlot;
+
+  bool Broadcast(Request request, int num_steps);
+  bool WaitForWorker(int worker);
+  bool IsWorkerAlive(int worker);
+  void StartEpisode(int worker, const EpisodeSpec& spec);
+  WorkerSlot* slot(int worker) const;
+  double* command_data() const;
+  double* state_data() const;
+  double* episode_data(int worker) const;
+
+  [[noreturn]] void RunWorker(int worker);
+  bool RunEpisode(int worker, GazeboServer* server,
+                  EpisodeController* controller, CommandBuffer* commands);
+  void ShutDown();
+
+  const Config config_;
+  bool initialized_ = false;
+
+  void* shared_memory_ = nullptr;
+  std::size_t shared_memory_size_ = 0;
+  std::vector<pid_t> worker_pids_;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_GAZEBO_SERVER_POOL_H_
@@ -18,6 +18,7 @@
 #include <string>
 
 #include <Eigen/Geometry>
+#include <ignition/math/Pose3.hh>
 
 namespace gazebo_server {
 
@@ -47,10 +48,24 @@ inline Eigen::Matrix3d EulerAnglesToDcm(const Eigen::Vector3d& rpy) {
       .toRotationMatrix();
 }
 
+inline ignition::math::Pose3d ToPose(const Eigen::Vector3d& world_p_body,
+                                     const Eigen::Matrix3d& world_r_body) {
+  const Eigen::Quaterniond world_q_body(world_r_body);
+  return ignition::math::Pose3d(
+      ignition::math::Vector3d(world_p_body.x(), world_p_body.y(),
+                               world_p_body.z()),
+      ignition::math::Quaterniond(world_q_body.w(), world_q_body.x(),
+                                  world_q_body.y(), world_q_body.z()));
+}
+
 std::string UrdfToSdf(const std::string& model_urdf_xml);
 
 std::string GetRobotName(const std::string& model_sdf_xml);
 
+// Returns the SDF XML with the model renamed, or an empty string on failure.
+std::string SetRobotName(const std::string& model_sdf_xml,
+                         const std::string& robot_name);
+
 }  // namespace gazebo_server
 
 #endif  // GAZEBO_SERVER_HELPERS_H_
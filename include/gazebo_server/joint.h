@@ -20,28 +20,57 @@ namespace gazebo_server {
 
 class GazeboServer;
 
+// Refers to a single axis of a Gazebo joint.
+struct JointAxis {
+  gazebo::physics::Joint* joint;
+  unsigned int axis;
+};
+
 /**
  * Wraps a subset of Gazebo's Joint class methods.
  *
- * The API acts on the 0-th axis of the joint.
+ * Methods act on the given axis of the joint, the 0-th one by default.
+ * Axes are numbered from zero to DOF() - 1. For other axes, setters return
+ * false and getters return NaN.
+ *
+ * A light-weight view which can be copied freely. It is valid as long as
+ * the server which created it.
  */
 class Joint {
  public:
-  void SetTorque(double torque);
-  double GetTorque() const;
+  // The number of axes (degrees of freedom) of the joint.
+  unsigned int DOF() const;
+
+  bool SetTorque(double torque, unsigned int axis = 0);
+  double GetTorque(unsigned int axis = 0) const;
 
-  double GetVelocity() const;
-  double GetPosition() const;
+  double GetVelocity(unsigned int axis = 0) const;
+  double GetPosition(unsigned int axis = 0) const;
+
+  // Sets the position kinematically, moving the child links.
+  bool SetPosition(double position, unsigned int axis = 0);
+  // Sets the velocity, moving the child links.
+  bool SetVelocity(double velocity, unsigned int axis = 0);
+
+  // Position limits from the model XML.
+  double GetLowerLimit(unsigned int axis = 0) const;
+  double GetUpperLimit(unsigned int axis = 0) const;
+  // The effort and velocity limits from the model XML, negative if the axis
+  // is not limited.
+  double GetEffortLimit(unsigned int axis = 0) const;
+  double GetVelocityLimit(unsigned int axis = 0) const;
 
  protected:
-  explicit Joint(gazebo::physics::JointPtr joint) : joint_(joint) {}
+  explicit Joint(gazebo::physics::Joint* joint) : joint_(joint) {}
 
  private:
   friend class GazeboServer;
 
   Joint() = delete;
 
-  gazebo::physics::JointPtr joint_;
+  bool IsValidAxis(unsigned int axis) const;
+
+  gazebo::physics::Joint* joint_;
 };
 
 }  // namespace gazebo_server
@@ -23,6 +23,9 @@ class GazeboServer;
 
 /**
  * Wraps a subset of Gazebo's Link class methods in Eigen API.
+ *
+ * A light-weight view which can be copied freely. It is valid as long as
+ * the server which created it.
  */
 class Link {
  public:
@@ -38,15 +41,19 @@ class Link {
   Eigen::Vector3d GetRelativeAngularVel() const;
   Eigen::Vector3d GetRelativeAngularAccel() const;
 
+  // Sets the pose kinematically. Moving the canonical link moves the model.
+  void SetWorldPose(const Eigen::Vector3d& world_p_link,
+                    const Eigen::Matrix3d& world_r_link);
+
  protected:
-  explicit Link(gazebo::physics::LinkPtr link) : link_(link) {}
+  explicit Link(gazebo::physics::Link* link) : link_(link) {}
 
  private:
   friend class GazeboServer;
 
   Link() = delete;
 
-  gazebo::physics::LinkPtr link_;
+  gazebo::physics::Link* link_;
 };
 
 }  // namespace gazebo_server
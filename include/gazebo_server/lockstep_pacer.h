@@ -0,0 +1,93 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_LOCKSTEP_PACER_H_
+#define GAZEBO_SERVER_LOCKSTEP_PACER_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "gazebo_server/step_statistics.h"
+#include "gazebo_server/time.h"
+
+namespace gazebo_server {
+
+/**
+ * Statistics of lockstep pacing.
+ *
+ * Every paced step is either on time, in which case the time left until its
+ * deadline is recorded as slack, or late, in which case the time past its
+ * deadline is recorded as overrun.
+ */
+struct PacingStatistics {
+  void Clear() {
+    slack.Clear();
+    overrun.Clear();
+    num_reanchors.store(0, std::memory_order_relaxed);
+  }
+
+  LatencyHistogram slack;
+  LatencyHistogram overrun;
+  // The number of times the pacer gave up catching up after a large overrun.
+  std::atomic<std::uint64_t> num_reanchors{0};
+};
+
+/**
+ * Locks the simulation time to the steady clock.
+ *
+ * The simulation time t is due at the wall-clock deadline
+ * anchor_wall_time + (t - anchor_simulation_time) / real_time_factor.
+ * Deadlines are absolute, such that sleeping errors don't accumulate:
+ * the pacer sleeps until shortly before a deadline and busy-waits the rest.
+ * A step which is late by more than the maximum lag re-anchors the pacer
+ * instead of letting the following steps run unpaced to catch up.
+ */
+class LockstepPacer {
+ public:
+  /**
+   * @param real_time_factor The ratio of simulation time to wall-clock time.
+   *                         Must be larger than zero.
+   * @param spin_duration How long before a deadline to stop sleeping and
+   *                      start busy-waiting.
+   * @param max_lag The overrun above which the pacer re-anchors.
+   */
+  LockstepPacer(double real_time_factor, SteadyClock::duration spin_duration,
+                SteadyClock::duration max_lag)
+      : real_time_factor_(real_time_factor),
+        spin_duration_(spin_duration),
+        max_lag_(max_lag) {}
+
+  // Makes the simulation time due now.
+  void Anchor(SteadyTimestamp simulation_time);
+
+  // Waits until the simulation time is due.
+  void WaitUntil(SteadyTimestamp simulation_time);
+
+  SteadyTimestamp GetDeadline(SteadyTimestamp simulation_time) const;
+
+  const PacingStatistics& statistics() const { return statistics_; }
+  void ClearStatistics() { statistics_.Clear(); }
+
+ private:
+  const double real_time_factor_;
+  const SteadyClock::duration spin_duration_;
+  const SteadyClock::duration max_lag_;
+
+  SteadyTimestamp anchor_wall_time_;
+  SteadyTimestamp anchor_simulation_time_;
+  PacingStatistics statistics_;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_LOCKSTEP_PACER_H_
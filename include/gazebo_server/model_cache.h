@@ -0,0 +1,106 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_MODEL_CACHE_H_
+#define GAZEBO_SERVER_MODEL_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+namespace gazebo_server {
+
+/**
+ * A robot model preprocessed for insertion into a world.
+ *
+ * Link and joint names are not part of it: the server indexes them from
+ * the loaded Gazebo model, which it needs for the link and joint pointers
+ * anyway.
+ */
+struct ModelDescription {
+  // The SDF XML, converted from URDF if needed.
+  std::string sdf_xml;
+  std::string robot_name;
+};
+
+/**
+ * Converts a URDF XML to SDF if needed and extracts the robot name.
+ *
+ * Doesn't validate the SDF, see ValidateModel().
+ *
+ * @param model_xml A SDF or URDF XML.
+ * @param description The resulting description.
+ *
+ * @returns True on success, false otherwise.
+ */
+bool DescribeModel(const std::string& model_xml, ModelDescription* description);
+
+// Returns true if the SDF XML of a description is valid, false otherwise.
+bool ValidateModel(const ModelDescription& description);
+
+/**
+ * An on-disk cache of model descriptions keyed by the content hash of the
+ * model XML.
+ *
+ * Parsing, converting and validating a large model takes a considerable part
+ * of the server startup. The cache stores the result of DescribeModel(),
+ * validated by ValidateModel(), in a plain file per model, such that repeated
+ * starts with the same model only read that file back. Entries are keyed by
+ * the model XML and the SDFormat version. Entries are written atomically,
+ * processes may share a cache directory.
+ */
+class ModelCache {
+ public:
+  // The cache directory must exist.
+  explicit ModelCache(const std::string& directory) : directory_(directory) {}
+
+  /**
+   * Gets the description of a model, from the cache if possible.
+   *
+   * @param model_xml A SDF or URDF XML.
+   * @param description The resulting description.
+   *
+   * @returns True on success, false otherwise. Failing to write a new cache
+   *          entry is not an error.
+   */
+  bool Load(const std::string& model_xml, ModelDescription* description);
+
+  // The path of the cache entry of a model XML.
+  std::string GetEntryPath(const std::string& model_xml) const;
+
+  const std::string& directory() const { return directory_; }
+  int num_hits() const { return num_hits_; }
+  int num_misses() const { return num_misses_; }
+
+  static constexpr std::uint64_t kHashOffsetBasis = 0xcbf29ce484222325;
+
+  // The 64-bit FNV-1a hash, continuing from the given hash value.
+  static std::uint64_t Hash(const std::string& data,
+                            std::uint64_t hash = kHashOffsetBasis);
+
+ private:
+  // The hash of the model XML and the SDFormat version.
+  static std::uint64_t GetKey(const std::string& model_xml);
+
+  bool Read(const std::string& path, const std::string& model_xml,
+            ModelDescription* description) const;
+  bool Write(const std::string& path, const std::string& model_xml,
+             const ModelDescription& description) const;
+
+  const std::string directory_;
+  int num_hits_ = 0;
+  int num_misses_ = 0;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_MODEL_CACHE_H_
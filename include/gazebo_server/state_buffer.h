@@ -0,0 +1,108 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_STATE_BUFFER_H_
+#define GAZEBO_SERVER_STATE_BUFFER_H_
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <gazebo/physics/PhysicsTypes.hh>
+
+#include "gazebo_server/joint.h"
+#include "gazebo_server/time.h"
+
+namespace gazebo_server {
+
+class GazeboServer;
+template <typename... Channels>
+class ChannelReader;
+
+/**
+ * Holds the state of a fixed set of links and joints.
+ *
+ * The buffer is resolved once by GazeboServer::ResolveStateBuffer() and
+ * filled by GazeboServer::ReadState() without memory allocations.
+ * All channels live in one contiguous vector, see data(), where each channel
+ * occupies a contiguous block:
+ * - world_p_link: 3 x num_links,
+ * - world_q_link: 4 x num_links, quaternions stored as (x, y, z, w),
+ * - world_v_link: 3 x num_links, linear velocities in the world frame,
+ * - world_w_link: 3 x num_links, angular velocities in the world frame,
+ * - joint_position, joint_velocity, joint_effort: num_joint_axes each,
+ *   one entry per axis of every joint.
+ */
+class StateBuffer {
+ public:
+  using Matrix3Xd = Eigen::Matrix<double, 3, Eigen::Dynamic>;
+  using Matrix4Xd = Eigen::Matrix<double, 4, Eigen::Dynamic>;
+
+  static constexpr int kLinkStateSize = 13;
+  static constexpr int kJointAxisStateSize = 3;
+
+  int num_links() const { return links_.size(); }
+  int num_joint_axes() const { return joint_axes_.size(); }
+  const std::vector<std::string>& link_names() const { return link_names_; }
+  const std::vector<std::string>& joint_names() const { return joint_names_; }
+
+  SteadyTimestamp simulation_time() const { return simulation_time_; }
+
+  Eigen::Map<const Matrix3Xd> world_p_link() const {
+    return {data_.data(), 3, num_links()};
+  }
+  Eigen::Map<const Matrix4Xd> world_q_link() const {
+    return {data_.data() + 3 * num_links(), 4, num_links()};
+  }
+  Eigen::Map<const Matrix3Xd> world_v_link() const {
+    return {data_.data() + 7 * num_links(), 3, num_links()};
+  }
+  Eigen::Map<const Matrix3Xd> world_w_link() const {
+    return {data_.data() + 10 * num_links(), 3, num_links()};
+  }
+
+  Eigen::Map<const Eigen::VectorXd> joint_position() const {
+    return {joint_data(), num_joint_axes()};
+  }
+  Eigen::Map<const Eigen::VectorXd> joint_velocity() const {
+    return {joint_data() + num_joint_axes(), num_joint_axes()};
+  }
+  Eigen::Map<const Eigen::VectorXd> joint_effort() const {
+    return {joint_data() + 2 * num_joint_axes(), num_joint_axes()};
+  }
+
+  // All channels, concatenated.
+  const Eigen::VectorXd& data() const { return data_; }
+
+ private:
+  friend class GazeboServer;
+  template <typename... Channels>
+  friend class ChannelReader;
+
+  const double* joint_data() const {
+    return data_.data() + kLinkStateSize * num_links();
+  }
+
+  std::vector<std::string> link_names_;
+  std::vector<std::string> joint_names_;
+  std::vector<gazebo::physics::LinkPtr> links_;
+  std::vector<gazebo::physics::JointPtr> joints_;
+  std::vector<JointAxis> joint_axes_;
+
+  SteadyTimestamp simulation_time_;
+  Eigen::VectorXd data_;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_STATE_BUFFER_H_
@@ -0,0 +1,155 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_STATE_PUBLISHER_H_
+#define GAZEBO_SERVER_STATE_PUBLISHER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "gazebo_server/state_buffer.h"
+#include "gazebo_server/time.h"
+
+namespace gazebo_server {
+
+namespace internal {
+struct PublisherHeader;
+struct PublisherSlot;
+}  // namespace internal
+
+/**
+ * Publishes states into a ring buffer in POSIX shared memory.
+ *
+ * Every published state goes to the next slot of the ring. Each slot is
+ * guarded by a sequence lock: the writer never waits for readers, readers
+ * retry if a slot got overwritten while they were copying it. Any number of
+ * StateSubscriber instances in other processes can follow the states at their
+ * own rate, without any effect on the publisher.
+ *
+ * A single thread may publish at a time.
+ */
+class StatePublisher {
+ public:
+  StatePublisher() = default;
+  ~StatePublisher() { Close(); }
+
+  StatePublisher(const StatePublisher&) = delete;
+  StatePublisher& operator=(const StatePublisher&) = delete;
+
+  /**
+   * Creates the shared memory object and lays out the ring buffer.
+   *
+   * @param name The name of the shared memory object, e.g. "/robot_state".
+   *             An existing object with the same name is replaced.
+   * @param buffer A resolved buffer which defines the published channels.
+   * @param num_slots The number of states kept in the ring, larger than zero.
+   *
+   * @returns True on success, false otherwise.
+   */
+  bool Open(const std::string& name, const StateBuffer& buffer, int num_slots);
+
+  // Unmaps and unlinks the shared memory object. Subscribers which have it
+  // mapped can still read the last states.
+  void Close();
+
+  // Copies the state of a buffer with the layout given to Open().
+  void Publish(const StateBuffer& buffer);
+
+  bool is_open() const { return header_ != nullptr; }
+  const std::string& name() const { return name_; }
+  // The number of states published since Open().
+  std::uint64_t num_published() const { return num_published_; }
+
+ private:
+  internal::PublisherSlot* slot(std::uint64_t index) const;
+
+  std::string name_;
+  internal::PublisherHeader* header_ = nullptr;
+  std::size_t size_ = 0;
+  std::uint64_t num_published_ = 0;
+};
+
+/**
+ * A state read from a StatePublisher.
+ *
+ * The data has the layout of StateBuffer::data().
+ */
+struct StateSample {
+  // The index of the state, counted from zero since the publisher opened.
+  std::uint64_t index = 0;
+  SteadyTimestamp simulation_time;
+  Eigen::VectorXd data;
+};
+
+/**
+ * Reads states published by a StatePublisher, typically in another process.
+ */
+class StateSubscriber {
+ public:
+  StateSubscriber() = default;
+  ~StateSubscriber() { Close(); }
+
+  StateSubscriber(const StateSubscriber&) = delete;
+  StateSubscriber& operator=(const StateSubscriber&) = delete;
+
+  /**
+   * Maps the shared memory object of a publisher.
+   *
+   * @param name The name given to StatePublisher::Open().
+   *
+   * @returns True on success, false otherwise.
+   */
+  bool Open(const std::string& name);
+  void Close();
+
+  /**
+   * Reads the latest state.
+   *
+   * @returns True on success, false if nothing has been published yet.
+   */
+  bool ReadLatest(StateSample* sample) const;
+
+  /**
+   * Reads the state with the given index.
+   *
+   * @returns True on success, false if the state hasn't been published yet
+   *          or has been overwritten already.
+   */
+  bool Read(std::uint64_t index, StateSample* sample) const;
+
+  // The number of states published so far.
+  std::uint64_t num_published() const;
+
+  bool is_open() const { return header_ != nullptr; }
+  int num_slots() const;
+  int num_links() const { return link_names_.size(); }
+  int num_joint_axes() const;
+  const std::vector<std::string>& link_names() const { return link_names_; }
+  const std::vector<std::string>& joint_names() const { return joint_names_; }
+
+ private:
+  const internal::PublisherSlot* slot(std::uint64_t index) const;
+
+  const internal::PublisherHeader* header_ = nullptr;
+  std::size_t size_ = 0;
+  std::vector<std::string> link_names_;
+  std::vector<std::string> joint_names_;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_STATE_PUBLISHER_H_
@@ -0,0 +1,61 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_STATE_SNAPSHOT_H_
+#define GAZEBO_SERVER_STATE_SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "gazebo_server/time.h"
+
+namespace gazebo_server {
+
+class GazeboServer;
+
+/**
+ * Holds a copy of the simulation state of the robot model.
+ *
+ * Snapshots are created by GazeboServer::SaveState() and applied by
+ * GazeboServer::RestoreState(). A snapshot can be reused for many saves,
+ * in which case saving doesn't allocate memory.
+ */
+class StateSnapshot {
+ public:
+  bool empty() const { return data_.empty(); }
+
+  std::size_t size_in_bytes() const {
+    return sizeof(*this) + data_.capacity() * sizeof(double);
+  }
+
+  SteadyTimestamp simulation_time() const {
+    return GetTimestamp(sim_time_sec_, sim_time_nsec_);
+  }
+
+ private:
+  friend class GazeboServer;
+
+  std::int32_t sim_time_sec_ = 0;
+  std::int32_t sim_time_nsec_ = 0;
+  // The seed and the state of the global random number generator.
+  unsigned int seed_ = 0;
+  std::mt19937 generator_;
+  // The raw physics state of all links of the model.
+  std::vector<double> data_;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_STATE_SNAPSHOT_H_
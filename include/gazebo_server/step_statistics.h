@@ -0,0 +1,137 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_STEP_STATISTICS_H_
+#define GAZEBO_SERVER_STEP_STATISTICS_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+#include "gazebo_server/time.h"
+
+namespace gazebo_server {
+
+/**
+ * A latency histogram with log-linear buckets, as in HdrHistogram.
+ *
+ * Durations are recorded in nanoseconds. Every power-of-two range is split
+ * into kNumSubBuckets linear buckets, which bounds the relative error of
+ * reported percentiles by 1 / kNumSubBuckets. Durations longer than
+ * kMaxValue are recorded as kMaxValue.
+ *
+ * A single thread records, any thread may read concurrently. Counters are
+ * relaxed atomics, such that recording costs a few plain loads and stores.
+ * Concurrent reads may observe a histogram in the middle of an update.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr int kNumSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kMaxShift = 36;
+  static constexpr std::uint64_t kMaxValue =
+      (std::uint64_t{1} << (kMaxShift + kSubBucketBits + 1)) - 1;
+  static constexpr int kNumBuckets = (kMaxShift + 2) * kNumSubBuckets;
+
+  LatencyHistogram() { Clear(); }
+
+  void Record(SteadyClock::duration duration) {
+    const auto count =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    const std::uint64_t value =
+        count < 0 ? 0 : std::min<std::uint64_t>(count, kMaxValue);
+    Increment(&buckets_[GetBucketIndex(value)], 1);
+    Increment(&count_, 1);
+    Increment(&sum_, value);
+    if (value < min_.load(std::memory_order_relaxed)) {
+      min_.store(value, std::memory_order_relaxed);
+    }
+    if (value > max_.load(std::memory_order_relaxed)) {
+      max_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  // Must not be called concurrently with Record().
+  void Clear();
+
+  std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  SteadyClock::duration min() const;
+  SteadyClock::duration max() const;
+  SteadyClock::duration mean() const;
+  SteadyClock::duration total() const;
+
+  /**
+   * Gets a percentile of recorded durations.
+   *
+   * @param percentile The percentile in [0, 100].
+   *
+   * @returns The upper bound of the bucket holding the percentile, capped by
+   *          the maximum, or zero if the histogram is empty.
+   */
+  SteadyClock::duration GetPercentile(double percentile) const;
+
+  // The number of durations recorded in a bucket.
+  std::uint64_t bucket_count(int index) const {
+    return buckets_[index].load(std::memory_order_relaxed);
+  }
+
+  static int GetBucketIndex(std::uint64_t value);
+  // The smallest and the largest duration in nanoseconds of a bucket.
+  static std::uint64_t GetBucketLowerBound(int index);
+  static std::uint64_t GetBucketUpperBound(int index);
+
+ private:
+  // Only the recording thread modifies counters, a read-modify-write
+  // instruction is not needed.
+  static void Increment(std::atomic<std::uint64_t>* counter,
+                        std::uint64_t value) {
+    counter->store(counter->load(std::memory_order_relaxed) + value,
+                   std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<std::uint64_t>, kNumBuckets> buckets_;
+  std::atomic<std::uint64_t> count_;
+  std::atomic<std::uint64_t> sum_;
+  std::atomic<std::uint64_t> min_;
+  std::atomic<std::uint64_t> max_;
+};
+
+/**
+ * Timings of world updates, collected by GazeboServer if
+ * GazeboServer::Config::collect_step_statistics is set.
+ *
+ * A world update consists of the following phases:
+ * - begin_callbacks: applying commands, begin hooks and the RunFor()
+ *   begin callback,
+ * - world_update: model and plugin updates before the physics update,
+ * - physics: collision detection and dynamics,
+ * - end_callbacks: refreshing the state buffer, end hooks and the RunFor()
+ *   end callback.
+ * The step histogram holds the duration of whole world updates, including
+ * the time spent on lockstep pacing between physics and end callbacks.
+ */
+struct StepStatistics {
+  void Clear();
+
+  LatencyHistogram begin_callbacks;
+  LatencyHistogram world_update;
+  LatencyHistogram physics;
+  LatencyHistogram end_callbacks;
+  LatencyHistogram step;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_STEP_STATISTICS_H_
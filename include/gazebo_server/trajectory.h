@@ -0,0 +1,39 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_TRAJECTORY_H_
+#define GAZEBO_SERVER_TRAJECTORY_H_
+
+#include <Eigen/Core>
+
+namespace gazebo_server {
+
+/**
+ * A sequence of recorded states, see GazeboServer::Rollout().
+ *
+ * The matrices are resized only if their size doesn't fit, so a trajectory
+ * can be reused for many rollouts without memory allocations.
+ */
+struct Trajectory {
+  using Matrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic,
+                               Eigen::RowMajor>;
+
+  // The simulation time in seconds of each recorded state.
+  Eigen::VectorXd simulation_time;
+  // One row per recorded state, holding StateBuffer::data().
+  Matrix states;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_TRAJECTORY_H_
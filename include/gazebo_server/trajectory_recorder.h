@@ -0,0 +1,109 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef GAZEBO_SERVER_TRAJECTORY_RECORDER_H_
+#define GAZEBO_SERVER_TRAJECTORY_RECORDER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace gazebo_server {
+
+/**
+ * Records rows of doubles into a memory-mapped columnar file.
+ *
+ * The file starts with a header of kHeaderSize bytes:
+ * - magic "GZTRAJ01" (8 bytes),
+ * - version, number of columns (uint32 each),
+ * - capacity, number of rows, data offset (uint64 each),
+ * - size of the names block (uint32) and the decimation (uint32),
+ * followed by the column names, each terminated by a newline. The data of
+ * column c starts at data_offset + c * capacity * 8 and holds num_rows
+ * doubles; all values are little-endian. The file is sized for the capacity
+ * up front, but unwritten parts occupy no disk space on file systems with
+ * sparse file support.
+ *
+ * Rows are gathered in a columnar chunk in memory and copied into the
+ * mapping once the chunk is full, such that every column is written
+ * sequentially. The number of rows in the header is updated on every flush,
+ * readers never see partially written rows.
+ */
+class TrajectoryRecorder {
+ public:
+  static constexpr std::size_t kHeaderSize = 48;
+
+  TrajectoryRecorder() = default;
+  ~TrajectoryRecorder() { Close(); }
+
+  TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+  TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+  /**
+   * Creates the file.
+   *
+   * @param path The path of the file, an existing file is replaced.
+   * @param column_names The names of columns, must not contain newlines.
+   * @param capacity The maximum number of rows.
+   * @param decimation Stored in the header for readers' information.
+   * @param chunk_size The number of rows gathered before copying them into
+   *                   the mapping.
+   *
+   * @returns True on success, false otherwise.
+   */
+  bool Open(const std::string& path,
+            const std::vector<std::string>& column_names,
+            std::uint64_t capacity, int decimation = 1, int chunk_size = 1024);
+
+  // Flushes the gathered rows and closes the file.
+  void Close();
+
+  /**
+   * Appends a row.
+   *
+   * @param values num_columns() values.
+   *
+   * @returns True on success, false if the file is full.
+   */
+  bool Record(const double* values);
+
+  // Copies the gathered rows into the mapping and updates the header.
+  void Flush();
+
+  bool is_open() const { return data_ != nullptr; }
+  const std::string& path() const { return path_; }
+  int num_columns() const { return num_columns_; }
+  std::uint64_t capacity() const { return capacity_; }
+  std::uint64_t num_rows() const { return num_rows_ + chunk_rows_; }
+
+ private:
+  std::string path_;
+  char* data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t data_offset_ = 0;
+  int num_columns_ = 0;
+  std::uint64_t capacity_ = 0;
+  // The number of rows in the mapping.
+  std::uint64_t num_rows_ = 0;
+
+  // Gathered rows, column-major.
+  Eigen::MatrixXd chunk_;
+  int chunk_rows_ = 0;
+};
+
+}  // namespace gazebo_server
+
+#endif  // GAZEBO_SERVER_TRAJECTORY_RECORDER_H_
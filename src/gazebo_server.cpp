@@ -13,20 +13,78 @@
 // limitations under the License.
 #include "gazebo_server/gazebo_server.h"
 
-#include <thread>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <type_traits>
 
 #include <gazebo/common/common.hh>
 #include <gazebo/gazebo.hh>
+#include <gazebo/physics/ode/ODELink.hh>
 #include <gazebo/physics/physics.hh>
 #include <ignition/math/Rand.hh>
 #include <ode/ode.h>
 
 #include "gazebo_server/helpers.h"
+#include "gazebo_server/model_cache.h"
 
 // TODO(mvukov) In principle, we could route those as Gazebo warnings.
 extern "C" void SilenceOdeMessages(int, const char*, va_list) {}
 
 namespace gazebo_server {
+namespace {
+
+// Per-link snapshot layout: ODE body position (3), quaternion (4), linear
+// velocity (3), angular velocity (3), force (3), torque (3), enabled flag (1),
+// followed by the world pose of the link (7) as cached by Gazebo.
+constexpr int kBodyStateSize = 20;
+constexpr int kLinkPoseSize = 7;
+constexpr int kLinkSnapshotSize = kBodyStateSize + kLinkPoseSize;
+
+// ignition::math::Rand keeps its generator private, yet snapshots need its
+// state. Explicit instantiations may name private members; the friend
+// function hands out the address of the accessor.
+using RandGeneratorFunction = ignition::math::GeneratorType& (*)();
+RandGeneratorFunction GetRandGeneratorFunction();
+
+template <RandGeneratorFunction Function>
+struct RandGeneratorAccess {
+  friend RandGeneratorFunction GetRandGeneratorFunction() { return Function; }
+};
+template struct RandGeneratorAccess<&ignition::math::Rand::RandGenerator>;
+
+static_assert(std::is_same<ignition::math::GeneratorType, std::mt19937>::value,
+              "StateSnapshot expects a std::mt19937 generator!");
+
+ignition::math::GeneratorType& GetRandGenerator() {
+  return GetRandGeneratorFunction()();
+}
+
+dBodyID GetOdeBody(const gazebo::physics::LinkPtr& link) {
+  return static_cast<gazebo::physics::ODELink*>(link.get())->GetODEId();
+}
+
+gazebo::physics::FrictionPyramidPtr GetFrictionPyramid(
+    const gazebo::physics::CollisionPtr& collision) {
+  const auto surface = collision->GetSurface();
+  return surface != nullptr ? surface->FrictionPyramid() : nullptr;
+}
+
+void SetFriction(const gazebo::physics::CollisionPtr& collision,
+                 double mu_primary, double mu_secondary) {
+  const auto friction_pyramid = GetFrictionPyramid(collision);
+  if (friction_pyramid != nullptr) {
+    friction_pyramid->SetMuPrimary(mu_primary);
+    friction_pyramid->SetMuSecondary(mu_secondary);
+  }
+}
+
+}  // namespace
+
+GazeboServer::ModelConfig::ModelConfig() {
+  init_world_p_body.setZero();
+  init_world_rpy_body.setZero();
+}
 
 GazeboServer::Config::Config() {
   init_world_p_body.setZero();
@@ -54,6 +112,28 @@ bool GazeboServer::Config::Validate() const {
     std::cerr << "Got an empty model XML file!" << std::endl;
     return false;
   }
+  for (const auto& model : additional_models) {
+    if (model.sdf_xml.empty()) {
+      std::cerr << "Got an empty additional model XML file!" << std::endl;
+      return false;
+    }
+  }
+  if (lockstep_real_time_factor < 0) {
+    std::cerr << "The lockstep real-time factor must not be negative!"
+              << std::endl;
+    return false;
+  }
+  if (lockstep_real_time_factor > 0 &&
+      real_time_update_rate != kAsFastAsPossible) {
+    std::cerr << "Lockstep pacing requires the real-time update rate to be "
+                 "kAsFastAsPossible!"
+              << std::endl;
+    return false;
+  }
+  if (lockstep_spin_duration.count() < 0 || lockstep_max_lag.count() < 0) {
+    std::cerr << "Got a negative lockstep pacing duration!" << std::endl;
+    return false;
+  }
   return true;
 }
 
@@ -70,10 +150,16 @@ bool GazeboServer::Start() {
     return false;
   }
 
-  robot_name_ = GetRobotName(config_.model_sdf_xml);
-  if (robot_name_.empty()) {
+  const auto start_time = SteadyClock::now();
+  startup_timings_ = StartupTimings();
+
+  auto phase_start_time = SteadyClock::now();
+  std::vector<std::string> model_sdf_xmls;
+  if (!DescribeModels(&model_sdf_xmls)) {
     return false;
   }
+  robot_name_ = robot_names_.front();
+  startup_timings_.describe_models = SteadyClock::now() - phase_start_time;
 
   std::vector<std::string> gazebo_args;
   if (config_.verbose) {
@@ -84,11 +170,13 @@ bool GazeboServer::Start() {
     gazebo::common::Console::SetQuiet(true);
   }
 
+  phase_start_time = SteadyClock::now();
   if (!gazebo::setupServer(gazebo_args)) {
     gzerr << "Failed to set up server!" << std::endl;
     ShutDown();
     return false;
   }
+  startup_timings_.setup_server = SteadyClock::now() - phase_start_time;
 
   for (const auto& path : config_.media_paths) {
     gazebo::common::SystemPaths::Instance()->AddGazeboPaths(path);
@@ -98,39 +186,45 @@ bool GazeboServer::Start() {
   }
 
   gzmsg << "Loading world..." << std::endl;
+  phase_start_time = SteadyClock::now();
   world_ = gazebo::loadWorld(config_.world_path);
   if (world_ == nullptr) {
     gzerr << "Failed to fetch world!" << std::endl;
     ShutDown();
     return false;
   }
+  startup_timings_.load_world = SteadyClock::now() - phase_start_time;
 
   gzmsg << "Loading model..." << std::endl;
-  world_->InsertModelString(config_.model_sdf_xml);
-
-  static constexpr int kNumAttempts = 500;
-  static constexpr int kTimeoutMsec = 10;
-  int attempt = 0;
-  for (; attempt < kNumAttempts; ++attempt) {
-    gazebo::runWorld(world_, 1);
-    model_ = world_->ModelByName(robot_name_);
-    if (model_ != nullptr) {
-      break;
-    }
-    std::this_thread::sleep_for(std::chrono::milliseconds(kTimeoutMsec));
-  }
-  if (attempt == kNumAttempts) {
-    gzerr << "Failed to fetch robot model with name: " << robot_name_
-          << std::endl;
+  phase_start_time = SteadyClock::now();
+  if (!InsertModels(model_sdf_xmls)) {
     ShutDown();
     return false;
   }
-  assert(model_ != nullptr);
-  gzmsg << "Robot model became available after <= "
-        << (attempt + 1) * kTimeoutMsec << " [ms]" << std::endl;
+  startup_timings_.insert_model = SteadyClock::now() - phase_start_time;
+
+  world_->SetPhysicsEnabled(config_.enable_physics_engine);
+  CaptureNominalLinkParameters();
+
+  world_update_begin_ = gazebo::event::Events::ConnectWorldUpdateBegin(
+      [this](const gazebo::common::UpdateInfo&) { OnWorldUpdateBegin(); });
+  world_update_end_ = gazebo::event::Events::ConnectWorldUpdateEnd(
+      [this]() { OnWorldUpdateEnd(); });
+  if (config_.collect_step_statistics) {
+    before_physics_update_ = gazebo::event::Events::ConnectBeforePhysicsUpdate(
+        [this](const gazebo::common::UpdateInfo&) { OnBeforePhysicsUpdate(); });
+  }
 
   initialized_ = true;
   Reset();
+  if (world_->Physics()->GetType() == "ode") {
+    CaptureState(&initial_state_);
+  } else if (config_.fast_reset) {
+    gzerr << "Fast reset requires the ODE physics engine!" << std::endl;
+    initialized_ = false;
+    ShutDown();
+    return false;
+  }
 
   if (!config_.verbose) {
     auto physics_engine = world_->Physics();
@@ -139,16 +233,28 @@ bool GazeboServer::Start() {
     }
   }
 
-  std::stringstream sstream;
-  sstream << "Model links: ";
-  for (auto link : model_->GetLinks()) {
-    sstream << link->GetName() << " ";
-  }
-  sstream << ". Model joints: ";
-  for (auto joint : model_->GetJoints()) {
-    sstream << joint->GetName() << " ";
+  for (const auto& model : models_) {
+    std::stringstream sstream;
+    sstream << "Model " << model->GetName() << " links: ";
+    for (auto link : model->GetLinks()) {
+      sstream << link->GetName() << " ";
+    }
+    sstream << ". Model joints: ";
+    for (auto joint : model->GetJoints()) {
+      sstream << joint->GetName() << " ";
+    }
+    gzmsg << sstream.str() << std::endl;
   }
-  gzmsg << sstream.str() << std::endl;
+
+  startup_timings_.total = SteadyClock::now() - start_time;
+
+  using Msec = std::chrono::duration<double, std::milli>;
+  gzmsg << "Startup timings [ms]: setup server "
+        << Msec(startup_timings_.setup_server).count() << ", load world "
+        << Msec(startup_timings_.load_world).count() << ", insert model "
+        << Msec(startup_timings_.insert_model).count() << " ("
+        << startup_timings_.num_insertion_steps << " steps), total "
+        << Msec(startup_timings_.total).count() << std::endl;
 
   return true;
 }
@@ -157,12 +263,19 @@ bool GazeboServer::Step() {
   if (!IsReady()) {
     return false;
   }
+  AnchorPacer();
   gazebo::runWorld(world_, 1);
   return true;
 }
 
 bool GazeboServer::RunFor(int num_steps, Callback on_world_update_begin,
                           Callback on_world_update_end) {
+  return RunFor(num_steps, 1, std::move(on_world_update_begin),
+                std::move(on_world_update_end));
+}
+
+bool GazeboServer::RunFor(int num_steps, int decimation,
+                          Callback on_control_begin, Callback on_control_end) {
   if (!IsReady()) {
     return false;
   }
@@ -171,54 +284,418 @@ bool GazeboServer::RunFor(int num_steps, Callback on_world_update_begin,
           << std::endl;
     return false;
   }
-  if (!on_world_update_begin) {
+  if (decimation < 1) {
+    gzerr << "The decimation must be larger than zero!" << std::endl;
+    return false;
+  }
+  if (!on_control_begin) {
     gzerr << "on_world_update_begin callback must be defined!" << std::endl;
     return false;
   }
 
-  gazebo::event::ConnectionPtr world_begin;
-  gazebo::event::ConnectionPtr world_end;
+  run_for_begin_ = &on_control_begin;
+  if (on_control_end) {
+    run_for_end_ = &on_control_end;
+  }
+  run_for_decimation_ = decimation;
+  run_for_step_ = 0;
+  AnchorPacer();
+  gazebo::runWorld(world_, num_steps);
+  run_for_begin_ = nullptr;
+  run_for_end_ = nullptr;
 
-  world_begin = gazebo::event::Events::ConnectWorldUpdateBegin(
-      [&on_world_update_begin](const gazebo::common::UpdateInfo&) {
-        on_world_update_begin();
-      });
+  return true;
+}
 
-  if (on_world_update_end) {
-    world_end =
-        gazebo::event::Events::ConnectWorldUpdateEnd(on_world_update_end);
+bool StepFuture::get() const {
+  const bool success = future_.get();
+  if (server_ != nullptr) {
+    server_->CollectAsyncState();
   }
+  return success;
+}
 
-  gazebo::runWorld(world_, num_steps);
+StepFuture GazeboServer::StepAsync(int num_steps) {
+  std::promise<bool> failure;
+  failure.set_value(false);
+  if (!IsReady()) {
+    return StepFuture(nullptr, failure.get_future());
+  }
+  if (num_steps < 1) {
+    gzerr << "The number of requested steps must be larger than zero!"
+          << std::endl;
+    return StepFuture(nullptr, failure.get_future());
+  }
+  CollectAsyncState();
 
-  return true;
+  if (command_buffer_ != nullptr) {
+    async_command_buffer_ = *command_buffer_;
+  }
+  if (!simulation_thread_.joinable()) {
+    simulation_thread_ = std::thread([this]() { RunSimulationThread(); });
+  }
+
+  std::future<bool> future;
+  {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    async_promise_ = std::promise<bool>();
+    future = async_promise_.get_future();
+    async_num_steps_ = num_steps;
+    busy_ = true;
+  }
+  async_condition_.notify_one();
+  return StepFuture(this, std::move(future));
 }
 
-bool GazeboServer::Reset() {
+bool GazeboServer::Rollout(const Eigen::MatrixXd& joint_commands,
+                           int steps_per_command, Trajectory* out) {
+  assert(out != nullptr);
   if (!IsReady()) {
     return false;
   }
+  if (command_buffer_ == nullptr || state_buffer_ == nullptr) {
+    gzerr << "Rollout requires a command buffer and a state buffer!"
+          << std::endl;
+    return false;
+  }
+  if (joint_commands.rows() < 1 ||
+      joint_commands.cols() != command_buffer_->num_joint_axes()) {
+    gzerr << "Got invalid joint commands of size " << joint_commands.rows()
+          << "x" << joint_commands.cols() << "!" << std::endl;
+    return false;
+  }
+  if (steps_per_command < 1) {
+    gzerr << "The number of steps per command must be larger than zero!"
+          << std::endl;
+    return false;
+  }
 
-  const Eigen::Vector3d& world_p_body = config_.init_world_p_body;
-  const Eigen::Vector3d& world_rpy_body = config_.init_world_rpy_body;
-  ignition::math::Pose3d initial_pose(world_p_body.x(), world_p_body.y(),
-                                      world_p_body.z(), world_rpy_body.x(),
-                                      world_rpy_body.y(), world_rpy_body.z());
+  const auto num_commands = joint_commands.rows();
+  out->simulation_time.resize(num_commands);
+  out->states.resize(num_commands, state_buffer_->data().size());
 
-  model_->SetInitialRelativePose(initial_pose);
-  model_->SetRelativePose(initial_pose);
-  ignition::math::Rand::Seed(config_.seed);
+  RolloutProgress rollout = {&joint_commands, steps_per_command, 0, out};
+  rollout_ = &rollout;
+  AnchorPacer();
+  gazebo::runWorld(world_, num_commands * steps_per_command);
+  rollout_ = nullptr;
 
-  world_->Reset();
+  return rollout.step == num_commands * steps_per_command;
+}
 
-  if (config_.real_time_update_rate >= 0) {
-    auto physics_engine = world_->Physics();
-    physics_engine->SetRealTimeUpdateRate(config_.real_time_update_rate);
+int GazeboServer::AddHook(HookPoint point, FunctionRef hook) {
+  if (!initialized_ || IsBusy() || !hook) return -1;
+  auto& hooks = point == HookPoint::kWorldUpdateBegin
+                    ? world_update_begin_hooks_
+                    : world_update_end_hooks_;
+  const int hook_id = next_hook_id_++;
+  hooks.push_back({hook_id, hook});
+  return hook_id;
+}
+
+bool GazeboServer::RemoveHook(int hook_id) {
+  if (IsBusy()) return false;
+  for (auto* hooks : {&world_update_begin_hooks_, &world_update_end_hooks_}) {
+    const auto it = std::find_if(
+        hooks->begin(), hooks->end(),
+        [hook_id](const Hook& hook) { return hook.id == hook_id; });
+    if (it != hooks->end()) {
+      hooks->erase(it);
+      return true;
+    }
+  }
+  gzerr << "Failed to find hook " << hook_id << "!" << std::endl;
+  return false;
+}
+
+void GazeboServer::EndRun() {
+  if (world_ != nullptr) {
+    world_->Stop();
+  }
+}
+
+bool GazeboServer::Reset() { return Reset(ResetOptions()); }
+
+bool GazeboServer::Reset(const ResetOptions& options) {
+  if (!IsReady() || !ValidateResetOptions(options)) {
+    return false;
+  }
+
+  ApplyLinkParameters(options);
+
+  const Eigen::Vector3d world_p_body =
+      options.init_world_p_body.value_or(config_.init_world_p_body);
+  const Eigen::Vector3d world_rpy_body =
+      options.init_world_rpy_body.value_or(config_.init_world_rpy_body);
+  const ignition::math::Pose3d initial_pose(
+      world_p_body.x(), world_p_body.y(), world_p_body.z(), world_rpy_body.x(),
+      world_rpy_body.y(), world_rpy_body.z());
+
+  if (config_.fast_reset && !initial_state_.empty()) {
+    ApplyState(initial_state_);
+    if (options.init_world_p_body || options.init_world_rpy_body) {
+      model_->SetWorldPose(initial_pose);
+    }
+    if (options.seed) {
+      ignition::math::Rand::Seed(*options.seed);
+    }
+  } else {
+    model_->SetInitialRelativePose(initial_pose);
+    model_->SetRelativePose(initial_pose);
+    for (std::size_t robot = 1; robot < models_.size(); ++robot) {
+      const auto robot_initial_pose = GetInitialPose(robot);
+      models_[robot]->SetInitialRelativePose(robot_initial_pose);
+      models_[robot]->SetRelativePose(robot_initial_pose);
+    }
+    ignition::math::Rand::Seed(options.seed.value_or(config_.seed));
+
+    world_->Reset();
+
+    if (config_.real_time_update_rate >= 0) {
+      auto physics_engine = world_->Physics();
+      physics_engine->SetRealTimeUpdateRate(config_.real_time_update_rate);
+    }
   }
 
+  ApplyJointStates(options);
+  anchor_pacer_ = true;
+
+  RefreshStateBuffer();
+  return true;
+}
+
+bool GazeboServer::ResetToInitialState() {
+  if (initial_state_.empty()) {
+    gzerr << "The initial state has not been captured!" << std::endl;
+    return false;
+  }
+  return RestoreState(initial_state_);
+}
+
+bool GazeboServer::SetRobotPose(const Eigen::Vector3d& world_p_body,
+                                const Eigen::Matrix3d& world_r_body) {
+  return SetRobotPose(robot_name_, world_p_body, world_r_body);
+}
+
+bool GazeboServer::SetRobotPose(const std::string& robot_name,
+                                const Eigen::Vector3d& world_p_body,
+                                const Eigen::Matrix3d& world_r_body) {
+  if (!IsReady()) {
+    return false;
+  }
+  const auto it =
+      std::find(robot_names_.begin(), robot_names_.end(), robot_name);
+  if (it == robot_names_.end()) {
+    gzerr << "Failed to find robot " << robot_name << "!" << std::endl;
+    return false;
+  }
+  models_[it - robot_names_.begin()]->SetWorldPose(
+      ToPose(world_p_body, world_r_body));
+  RefreshStateBuffer();
+  return true;
+}
+
+bool GazeboServer::SaveState(StateSnapshot* snapshot) {
+  assert(snapshot != nullptr);
+  if (!IsReady() || !HasOdePhysics()) {
+    return false;
+  }
+  CaptureState(snapshot);
+  return true;
+}
+
+bool GazeboServer::RestoreState(const StateSnapshot& snapshot) {
+  if (!IsReady() || !HasOdePhysics()) {
+    return false;
+  }
+  if (snapshot.data_.size() != robot_links_.size() * kLinkSnapshotSize) {
+    gzerr << "The snapshot doesn't match the robot model!" << std::endl;
+    return false;
+  }
+  ApplyState(snapshot);
+  anchor_pacer_ = true;
+  RefreshStateBuffer();
+  return true;
+}
+
+bool GazeboServer::ResumePacing() {
+  if (!initialized_ || IsBusy()) return false;
+  anchor_pacer_ = true;
   return true;
 }
 
+bool GazeboServer::ValidateResetOptions(const ResetOptions& options) const {
+  for (const auto* joint_states :
+       {&options.joint_positions, &options.joint_velocities}) {
+    for (const auto& joint_state : *joint_states) {
+      const auto joint = FindJoint(joint_state.first);
+      if (joint == nullptr) {
+        gzerr << "Failed to find joint: " << joint_state.first << "!"
+              << std::endl;
+        return false;
+      }
+      if (joint->DOF() == 0) {
+        gzerr << "Joint " << joint_state.first << " has no axis!" << std::endl;
+        return false;
+      }
+    }
+  }
+  for (const auto& link_mass : options.link_masses) {
+    if (FindLink(link_mass.first) == nullptr) {
+      gzerr << "Failed to find link " << link_mass.first << "!" << std::endl;
+      return false;
+    }
+    if (link_mass.second <= 0) {
+      gzerr << "The mass of link " << link_mass.first
+            << " must be larger than zero!" << std::endl;
+      return false;
+    }
+  }
+  for (const auto& link_friction : options.link_frictions) {
+    if (FindLink(link_friction.first) == nullptr) {
+      gzerr << "Failed to find link " << link_friction.first << "!"
+            << std::endl;
+      return false;
+    }
+    if (link_friction.second < 0) {
+      gzerr << "The friction of link " << link_friction.first
+            << " must not be negative!" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+void GazeboServer::CaptureNominalLinkParameters() {
+  nominal_link_parameters_.clear();
+  for (const auto& link : robot_links_) {
+    LinkParameters parameters;
+    parameters.mass = link->GetInertial()->Mass();
+    for (const auto& collision : link->GetCollisions()) {
+      const auto friction_pyramid = GetFrictionPyramid(collision);
+      if (friction_pyramid != nullptr) {
+        parameters.frictions.emplace_back(friction_pyramid->MuPrimary(),
+                                          friction_pyramid->MuSecondary());
+      } else {
+        parameters.frictions.emplace_back(0.0, 0.0);
+      }
+    }
+    nominal_link_parameters_.push_back(std::move(parameters));
+  }
+}
+
+void GazeboServer::ApplyLinkParameters(const ResetOptions& options) {
+  if (link_parameters_overridden_) {
+    for (std::size_t index = 0; index < robot_links_.size(); ++index) {
+      const auto& link = robot_links_[index];
+      const auto& parameters = nominal_link_parameters_[index];
+      link->GetInertial()->SetMass(parameters.mass);
+      link->UpdateMass();
+      const auto& collisions = link->GetCollisions();
+      for (std::size_t collision = 0; collision < collisions.size();
+           ++collision) {
+        SetFriction(collisions[collision],
+                    parameters.frictions[collision].first,
+                    parameters.frictions[collision].second);
+      }
+    }
+    link_parameters_overridden_ = false;
+  }
+
+  for (const auto& link_mass : options.link_masses) {
+    auto link = FindLink(link_mass.first);
+    link->GetInertial()->SetMass(link_mass.second);
+    link->UpdateMass();
+    link_parameters_overridden_ = true;
+  }
+  for (const auto& link_friction : options.link_frictions) {
+    auto link = FindLink(link_friction.first);
+    for (const auto& collision : link->GetCollisions()) {
+      SetFriction(collision, link_friction.second, link_friction.second);
+    }
+    link_parameters_overridden_ = true;
+  }
+}
+
+void GazeboServer::ApplyJointStates(const ResetOptions& options) {
+  for (const auto& joint_position : options.joint_positions) {
+    FindJoint(joint_position.first)->SetPosition(0, joint_position.second);
+  }
+  for (const auto& joint_velocity : options.joint_velocities) {
+    FindJoint(joint_velocity.first)->SetVelocity(0, joint_velocity.second);
+  }
+}
+
+void GazeboServer::CaptureState(StateSnapshot* snapshot) const {
+  snapshot->data_.resize(robot_links_.size() * kLinkSnapshotSize);
+  double* data = snapshot->data_.data();
+  for (const auto& link : robot_links_) {
+    const dBodyID body = GetOdeBody(link);
+    if (body != nullptr) {
+      std::copy_n(dBodyGetPosition(body), 3, data);
+      std::copy_n(dBodyGetQuaternion(body), 4, data + 3);
+      std::copy_n(dBodyGetLinearVel(body), 3, data + 7);
+      std::copy_n(dBodyGetAngularVel(body), 3, data + 10);
+      std::copy_n(dBodyGetForce(body), 3, data + 13);
+      std::copy_n(dBodyGetTorque(body), 3, data + 16);
+      data[19] = dBodyIsEnabled(body);
+    } else {
+      std::fill_n(data, kBodyStateSize, 0.0);
+    }
+    data += kBodyStateSize;
+
+    const auto world_t_link = link->WorldPose();
+    data[0] = world_t_link.Pos().X();
+    data[1] = world_t_link.Pos().Y();
+    data[2] = world_t_link.Pos().Z();
+    data[3] = world_t_link.Rot().W();
+    data[4] = world_t_link.Rot().X();
+    data[5] = world_t_link.Rot().Y();
+    data[6] = world_t_link.Rot().Z();
+    data += kLinkPoseSize;
+  }
+
+  const auto sim_time = world_->SimTime();
+  snapshot->sim_time_sec_ = sim_time.sec;
+  snapshot->sim_time_nsec_ = sim_time.nsec;
+  snapshot->seed_ = ignition::math::Rand::Seed();
+  snapshot->generator_ = GetRandGenerator();
+}
+
+void GazeboServer::ApplyState(const StateSnapshot& snapshot) {
+  const double* data = snapshot.data_.data();
+  for (const auto& link : robot_links_) {
+    const dBodyID body = GetOdeBody(link);
+    if (body != nullptr) {
+      dBodySetPosition(body, data[0], data[1], data[2]);
+      dBodySetQuaternion(body, data + 3);
+      dBodySetLinearVel(body, data[7], data[8], data[9]);
+      dBodySetAngularVel(body, data[10], data[11], data[12]);
+      dBodySetForce(body, data[13], data[14], data[15]);
+      dBodySetTorque(body, data[16], data[17], data[18]);
+      if (data[19] != 0) {
+        dBodyEnable(body);
+      } else {
+        dBodyDisable(body);
+      }
+    }
+    data += kBodyStateSize;
+
+    // Updates only the pose cached by Gazebo, the physics state is restored
+    // above.
+    const ignition::math::Pose3d world_t_link(
+        ignition::math::Vector3d(data[0], data[1], data[2]),
+        ignition::math::Quaterniond(data[3], data[4], data[5], data[6]));
+    link->SetWorldPose(world_t_link, false, false);
+    data += kLinkPoseSize;
+  }
+
+  world_->SetSimTime(gazebo::common::Time(snapshot.sim_time_sec_,
+                                          snapshot.sim_time_nsec_));
+  ignition::math::Rand::Seed(snapshot.seed_);
+  GetRandGenerator() = snapshot.generator_;
+}
+
 SteadyTimestamp GazeboServer::GetSimulationTime() const {
   if (!initialized_) {
     return GetTimestamp(0);
@@ -228,7 +705,7 @@ SteadyTimestamp GazeboServer::GetSimulationTime() const {
 }
 
 bool GazeboServer::IsReady() const {
-  const auto ready = initialized_ && !world_->Running();
+  const auto ready = initialized_ && !busy_ && !world_->Running();
   if (!ready) {
     gzerr << "The server is not initialized and/or is already running!"
           << std::endl;
@@ -236,7 +713,181 @@ bool GazeboServer::IsReady() const {
   return ready;
 }
 
+bool GazeboServer::IsBusy() const {
+  if (busy_) {
+    gzerr << "The server is stepping asynchronously!" << std::endl;
+  }
+  return busy_;
+}
+
+bool GazeboServer::HasOdePhysics() const {
+  if (world_->Physics()->GetType() != "ode") {
+    gzerr << "The operation is supported only by the ODE physics engine!"
+          << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool GazeboServer::DescribeModels(std::vector<std::string>* model_sdf_xmls) {
+  std::unique_ptr<ModelCache> cache;
+  if (!config_.model_cache_path.empty()) {
+    cache = std::make_unique<ModelCache>(config_.model_cache_path);
+  }
+
+  // Pairs of model XMLs and names overriding the names in the XMLs.
+  std::vector<std::pair<std::string, std::string>> models = {
+      {config_.model_sdf_xml, std::string()}};
+  for (const auto& model : config_.additional_models) {
+    models.emplace_back(model.sdf_xml, model.name);
+  }
+
+  model_sdf_xmls->clear();
+  robot_names_.clear();
+  for (const auto& model : models) {
+    ModelDescription description;
+    const bool described = cache != nullptr
+                               ? cache->Load(model.first, &description)
+                               : DescribeModel(model.first, &description);
+    if (!described) {
+      return false;
+    }
+    if (!model.second.empty() && model.second != description.robot_name) {
+      description.sdf_xml = SetRobotName(description.sdf_xml, model.second);
+      if (description.sdf_xml.empty()) {
+        return false;
+      }
+      description.robot_name = model.second;
+    }
+    if (std::find(robot_names_.begin(), robot_names_.end(),
+                  description.robot_name) != robot_names_.end()) {
+      gzerr << "Got a duplicate robot name: " << description.robot_name << "!"
+            << std::endl;
+      return false;
+    }
+    robot_names_.push_back(description.robot_name);
+    model_sdf_xmls->push_back(std::move(description.sdf_xml));
+  }
+  return true;
+}
+
+bool GazeboServer::InsertModels(
+    const std::vector<std::string>& model_sdf_xmls) {
+  // The world loads models from its factory queue within world updates. The
+  // add-entity event tells when our models got loaded, so we step the world
+  // only as long as needed, without sleeping in between.
+  std::size_t num_inserted_models = 0;
+  auto add_entity = gazebo::event::Events::ConnectAddEntity(
+      [this, &num_inserted_models](const std::string& name) {
+        if (std::find(robot_names_.begin(), robot_names_.end(), name) !=
+            robot_names_.end()) {
+          ++num_inserted_models;
+        }
+      });
+
+  for (const auto& model_sdf_xml : model_sdf_xmls) {
+    world_->InsertModelString(model_sdf_xml);
+  }
+
+  static constexpr auto kTimeout = std::chrono::seconds(5);
+  const auto deadline = SteadyClock::now() + kTimeout;
+  while (num_inserted_models < robot_names_.size() &&
+         SteadyClock::now() < deadline) {
+    gazebo::runWorld(world_, 1);
+    ++startup_timings_.num_insertion_steps;
+  }
+  add_entity.reset();
+
+  models_.clear();
+  robot_links_.clear();
+  robot_joints_.clear();
+  for (const auto& robot_name : robot_names_) {
+    auto model = world_->ModelByName(robot_name);
+    if (model == nullptr) {
+      gzerr << "Failed to fetch robot model with name: " << robot_name
+            << std::endl;
+      return false;
+    }
+    models_.push_back(model);
+    const auto& links = model->GetLinks();
+    robot_links_.insert(robot_links_.end(), links.begin(), links.end());
+    const auto& joints = model->GetJoints();
+    robot_joints_.insert(robot_joints_.end(), joints.begin(), joints.end());
+  }
+  model_ = models_.front();
+
+  // Names of the first robot are given without its scope.
+  const std::string first_robot_scope = robot_names_.front() + "::";
+  const auto get_name = [&first_robot_scope](const std::string& scoped_name) {
+    if (scoped_name.compare(0, first_robot_scope.size(), first_robot_scope) ==
+        0) {
+      return scoped_name.substr(first_robot_scope.size());
+    }
+    return scoped_name;
+  };
+  link_names_.clear();
+  for (const auto& link : robot_links_) {
+    link_names_.push_back(get_name(link->GetScopedName()));
+  }
+  joint_names_.clear();
+  for (const auto& joint : robot_joints_) {
+    joint_names_.push_back(get_name(joint->GetScopedName()));
+  }
+  return true;
+}
+
+gazebo::physics::ModelPtr GazeboServer::FindRobot(
+    const std::string& scoped_name, std::string* name) const {
+  const auto separator = scoped_name.find("::");
+  if (separator != std::string::npos) {
+    const auto it = std::find(robot_names_.begin(), robot_names_.end(),
+                              scoped_name.substr(0, separator));
+    if (it != robot_names_.end()) {
+      *name = scoped_name.substr(separator + 2);
+      return models_[it - robot_names_.begin()];
+    }
+  }
+  *name = scoped_name;
+  return model_;
+}
+
+gazebo::physics::LinkPtr GazeboServer::FindLink(
+    const std::string& name) const {
+  std::string link_name;
+  const auto model = FindRobot(name, &link_name);
+  return model->GetLink(link_name);
+}
+
+gazebo::physics::JointPtr GazeboServer::FindJoint(
+    const std::string& name) const {
+  std::string joint_name;
+  const auto model = FindRobot(name, &joint_name);
+  return model->GetJoint(joint_name);
+}
+
+ignition::math::Pose3d GazeboServer::GetInitialPose(std::size_t robot) const {
+  const auto& model = config_.additional_models.at(robot - 1);
+  const Eigen::Vector3d& world_p_body = model.init_world_p_body;
+  const Eigen::Vector3d& world_rpy_body = model.init_world_rpy_body;
+  return ignition::math::Pose3d(world_p_body.x(), world_p_body.y(),
+                                world_p_body.z(), world_rpy_body.x(),
+                                world_rpy_body.y(), world_rpy_body.z());
+}
+
 void GazeboServer::ShutDown() {
+  if (simulation_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(async_mutex_);
+      stop_simulation_thread_ = true;
+    }
+    async_condition_.notify_one();
+    simulation_thread_.join();
+  }
+  state_publisher_.Close();
+  recorder_.Close();
+  world_update_begin_.reset();
+  world_update_end_.reset();
+  before_physics_update_.reset();
   gazebo::event::Events::stop();
   if ((world_ != nullptr || model_ != nullptr) && !gazebo::shutdown()) {
     std::cerr << "Failed to shut down the server!" << std::endl;
@@ -245,22 +896,443 @@ void GazeboServer::ShutDown() {
 
 std::unique_ptr<Link> GazeboServer::GetLink(const std::string& name) const {
   if (!initialized_) return nullptr;
-  auto link = model_->GetLink(name);
+  auto link = FindLink(name);
   if (link == nullptr) {
     gzerr << "Failed to find link " << name << "!" << std::endl;
     return nullptr;
   }
-  return std::unique_ptr<Link>(new Link(link));
+  return std::unique_ptr<Link>(new Link(link.get()));
 }
 
 std::unique_ptr<Joint> GazeboServer::GetJoint(const std::string& name) const {
   if (!initialized_) return nullptr;
-  auto joint = model_->GetJoint(name);
+  auto joint = FindJoint(name);
   if (joint == nullptr) {
     gzerr << "Failed to find joint: " << name << "!" << std::endl;
     return nullptr;
   }
-  return std::unique_ptr<Joint>(new Joint(joint));
+  return std::unique_ptr<Joint>(new Joint(joint.get()));
+}
+
+int GazeboServer::LinkIndex(const std::string& name) const {
+  if (!initialized_) return -1;
+  const auto it =
+      std::find(robot_links_.begin(), robot_links_.end(), FindLink(name));
+  if (it == robot_links_.end()) {
+    gzerr << "Failed to find link " << name << "!" << std::endl;
+    return -1;
+  }
+  return it - robot_links_.begin();
+}
+
+int GazeboServer::JointIndex(const std::string& name) const {
+  if (!initialized_) return -1;
+  const auto it =
+      std::find(robot_joints_.begin(), robot_joints_.end(), FindJoint(name));
+  if (it == robot_joints_.end()) {
+    gzerr << "Failed to find joint: " << name << "!" << std::endl;
+    return -1;
+  }
+  return it - robot_joints_.begin();
+}
+
+Link GazeboServer::GetLinkAt(int index) const {
+  assert(index >= 0 && index < static_cast<int>(robot_links_.size()));
+  return Link(robot_links_[index].get());
+}
+
+Joint GazeboServer::GetJointAt(int index) const {
+  assert(index >= 0 && index < static_cast<int>(robot_joints_.size()));
+  return Joint(robot_joints_[index].get());
+}
+
+bool GazeboServer::ResolveStateBuffer(
+    const std::vector<std::string>& link_names,
+    const std::vector<std::string>& joint_names, StateBuffer* buffer) const {
+  assert(buffer != nullptr);
+  if (!initialized_) return false;
+
+  StateBuffer resolved;
+  for (const auto& name : link_names) {
+    auto link = FindLink(name);
+    if (link == nullptr) {
+      gzerr << "Failed to find link " << name << "!" << std::endl;
+      return false;
+    }
+    resolved.links_.push_back(link);
+  }
+  if (!ResolveJoints(joint_names, &resolved.joints_, &resolved.joint_axes_)) {
+    return false;
+  }
+  resolved.link_names_ = link_names;
+  resolved.joint_names_ = joint_names;
+  resolved.data_.setZero(StateBuffer::kLinkStateSize * resolved.num_links() +
+                         StateBuffer::kJointAxisStateSize *
+                             resolved.num_joint_axes());
+  *buffer = std::move(resolved);
+  return ReadState(buffer);
+}
+
+bool GazeboServer::ReadState(StateBuffer* buffer) const {
+  assert(buffer != nullptr);
+  if (!initialized_) return false;
+
+  const int num_links = buffer->num_links();
+  double* world_p_link = buffer->data_.data();
+  double* world_q_link = world_p_link + 3 * num_links;
+  double* world_v_link = world_p_link + 7 * num_links;
+  double* world_w_link = world_p_link + 10 * num_links;
+  for (const auto& link : buffer->links_) {
+    const auto world_t_link = link->WorldPose();
+    const auto& p = world_t_link.Pos();
+    const auto& q = world_t_link.Rot();
+    const auto v = link->WorldLinearVel();
+    const auto w = link->WorldAngularVel();
+    *world_p_link++ = p.X();
+    *world_p_link++ = p.Y();
+    *world_p_link++ = p.Z();
+    *world_q_link++ = q.X();
+    *world_q_link++ = q.Y();
+    *world_q_link++ = q.Z();
+    *world_q_link++ = q.W();
+    *world_v_link++ = v.X();
+    *world_v_link++ = v.Y();
+    *world_v_link++ = v.Z();
+    *world_w_link++ = w.X();
+    *world_w_link++ = w.Y();
+    *world_w_link++ = w.Z();
+  }
+
+  const int num_joint_axes = buffer->num_joint_axes();
+  double* joint_position =
+      buffer->data_.data() + StateBuffer::kLinkStateSize * num_links;
+  double* joint_velocity = joint_position + num_joint_axes;
+  double* joint_effort = joint_velocity + num_joint_axes;
+  for (const auto& joint_axis : buffer->joint_axes_) {
+    *joint_position++ = joint_axis.joint->Position(joint_axis.axis);
+    *joint_velocity++ = joint_axis.joint->GetVelocity(joint_axis.axis);
+    *joint_effort++ = joint_axis.joint->GetForce(joint_axis.axis);
+  }
+
+  buffer->simulation_time_ = GetSimulationTime();
+  return true;
+}
+
+bool GazeboServer::ResolveCommandBuffer(
+    const std::vector<std::string>& joint_names, CommandBuffer* buffer) const {
+  assert(buffer != nullptr);
+  if (!initialized_) return false;
+
+  CommandBuffer resolved;
+  if (!ResolveJoints(joint_names, &resolved.joints_, &resolved.joint_axes_)) {
+    return false;
+  }
+  resolved.joint_names_ = joint_names;
+  const int num_joint_axes = resolved.num_joint_axes();
+  resolved.command_.setZero(num_joint_axes);
+  resolved.modes_.assign(num_joint_axes, ControlMode::kEffort);
+  resolved.kp_.setZero(num_joint_axes);
+  resolved.kd_.setZero(num_joint_axes);
+  resolved.effort_limit_.resize(num_joint_axes);
+  for (int index = 0; index < num_joint_axes; ++index) {
+    const auto& joint_axis = resolved.joint_axes_[index];
+    const double effort_limit =
+        joint_axis.joint->GetEffortLimit(joint_axis.axis);
+    resolved.effort_limit_(index) =
+        effort_limit < 0 ? std::numeric_limits<double>::infinity()
+                         : effort_limit;
+  }
+  *buffer = std::move(resolved);
+  return true;
+}
+
+bool GazeboServer::SetCommandBuffer(const CommandBuffer* buffer) {
+  if (!initialized_ || IsBusy()) return false;
+  command_buffer_ = buffer;
+  return true;
+}
+
+bool GazeboServer::SetStateBuffer(StateBuffer* buffer) {
+  if (!initialized_ || IsBusy()) return false;
+  CollectAsyncState();
+  state_buffer_ = buffer;
+  if (state_buffer_ != nullptr) {
+    async_state_buffer_ = *state_buffer_;
+  }
+  RefreshStateBuffer();
+  return true;
+}
+
+bool GazeboServer::OpenStatePublisher(
+    const std::string& name, const std::vector<std::string>& link_names,
+    const std::vector<std::string>& joint_names, int num_slots) {
+  if (!initialized_ || IsBusy()) return false;
+  state_publisher_.Close();
+  if (!ResolveStateBuffer(link_names, joint_names, &state_publisher_buffer_) ||
+      !state_publisher_.Open(name, state_publisher_buffer_, num_slots)) {
+    return false;
+  }
+  RefreshStateBuffer();
+  return true;
+}
+
+bool GazeboServer::CloseStatePublisher() {
+  if (IsBusy()) return false;
+  state_publisher_.Close();
+  return true;
+}
+
+bool GazeboServer::StartRecording(const std::string& path,
+                                  const std::vector<std::string>& link_names,
+                                  const std::vector<std::string>& joint_names,
+                                  std::uint64_t max_num_samples,
+                                  int decimation) {
+  if (!initialized_ || IsBusy()) return false;
+  recorder_.Close();
+  if (!ResolveStateBuffer(link_names, joint_names, &recorder_buffer_)) {
+    return false;
+  }
+  std::vector<std::string> column_names = {"simulation_time"};
+  for (const auto& name : GetChannelNames(recorder_buffer_)) {
+    column_names.push_back(name);
+  }
+  if (!recorder_.Open(path, column_names, max_num_samples, decimation)) {
+    return false;
+  }
+  recorder_row_.resize(column_names.size());
+  recorder_decimation_ = decimation;
+  recorder_step_ = 0;
+  RecordState();
+  return true;
+}
+
+bool GazeboServer::StopRecording() {
+  if (IsBusy()) return false;
+  recorder_.Close();
+  return true;
+}
+
+std::vector<std::string> GazeboServer::GetChannelNames(
+    const StateBuffer& buffer) const {
+  std::vector<std::string> names;
+  const std::vector<std::pair<std::string, std::string>> link_channels = {
+      {"world_p_link", "xyz"},
+      {"world_q_link", "xyzw"},
+      {"world_v_link", "xyz"},
+      {"world_w_link", "xyz"}};
+  for (const auto& channel : link_channels) {
+    for (const auto& link_name : buffer.link_names_) {
+      for (const char component : channel.second) {
+        names.push_back(link_name + "/" + channel.first + "/" + component);
+      }
+    }
+  }
+  for (const std::string channel :
+       {"joint_position", "joint_velocity", "joint_effort"}) {
+    for (std::size_t joint = 0; joint < buffer.joints_.size(); ++joint) {
+      const auto& joint_name = buffer.joint_names_[joint];
+      const unsigned int num_axes = buffer.joints_[joint]->DOF();
+      for (unsigned int axis = 0; axis < num_axes; ++axis) {
+        names.push_back(joint_name + "/" + channel +
+                        (num_axes > 1 ? "/" + std::to_string(axis) : ""));
+      }
+    }
+  }
+  return names;
+}
+
+void GazeboServer::RecordState() {
+  ReadState(&recorder_buffer_);
+  recorder_row_(0) = std::chrono::duration<double>(
+                         recorder_buffer_.simulation_time().time_since_epoch())
+                         .count();
+  recorder_row_.tail(recorder_row_.size() - 1) = recorder_buffer_.data();
+  if (!recorder_.Record(recorder_row_.data())) {
+    gzerr << "Trajectory file " << recorder_.path()
+          << " is full, stopped recording!" << std::endl;
+    recorder_.Close();
+  }
+}
+
+bool GazeboServer::ResolveJoints(
+    const std::vector<std::string>& joint_names,
+    std::vector<gazebo::physics::JointPtr>* joints,
+    std::vector<JointAxis>* joint_axes) const {
+  for (const auto& name : joint_names) {
+    auto joint = FindJoint(name);
+    if (joint == nullptr) {
+      gzerr << "Failed to find joint: " << name << "!" << std::endl;
+      return false;
+    }
+    if (joint->DOF() == 0) {
+      gzerr << "Joint " << name << " has no axis!" << std::endl;
+      return false;
+    }
+    for (unsigned int axis = 0; axis < joint->DOF(); ++axis) {
+      joint_axes->push_back({joint.get(), axis});
+    }
+    joints->push_back(joint);
+  }
+  return true;
+}
+
+void GazeboServer::ApplyCommands(const CommandBuffer& buffer,
+                                 const double* command, Eigen::Index stride) {
+  const int num_joint_axes = buffer.num_joint_axes();
+  for (int index = 0; index < num_joint_axes; ++index, command += stride) {
+    const auto& joint_axis = buffer.joint_axes_[index];
+    auto joint = joint_axis.joint;
+    const auto axis = joint_axis.axis;
+    double effort = *command;
+    switch (buffer.modes_[index]) {
+      case ControlMode::kEffort:
+        break;
+      case ControlMode::kPosition:
+        effort = buffer.kp_(index) * (*command - joint->Position(axis)) -
+                 buffer.kd_(index) * joint->GetVelocity(axis);
+        break;
+      case ControlMode::kVelocity:
+        effort = buffer.kd_(index) * (*command - joint->GetVelocity(axis));
+        break;
+    }
+    const double effort_limit = buffer.effort_limit_(index);
+    joint->SetForce(axis, std::clamp(effort, -effort_limit, effort_limit));
+  }
+}
+
+void GazeboServer::OnWorldUpdateBegin() {
+  const bool collect_step_statistics = config_.collect_step_statistics;
+  if (collect_step_statistics) {
+    step_begin_time_ = SteadyClock::now();
+  }
+  if (command_buffer_ != nullptr) {
+    if (rollout_ != nullptr) {
+      const auto& joint_commands = *rollout_->joint_commands;
+      const int command = rollout_->step / rollout_->steps_per_command;
+      ApplyCommands(*command_buffer_, &joint_commands.coeffRef(command, 0),
+                    joint_commands.outerStride());
+    } else if (stepping_async_) {
+      ApplyCommands(async_command_buffer_,
+                    async_command_buffer_.command_.data(), 1);
+    } else {
+      ApplyCommands(*command_buffer_, command_buffer_->command_.data(), 1);
+    }
+  }
+  for (const auto& hook : world_update_begin_hooks_) {
+    hook.function();
+  }
+  if (run_for_begin_ != nullptr &&
+      run_for_step_ % run_for_decimation_ == 0) {
+    (*run_for_begin_)();
+  }
+  if (collect_step_statistics) {
+    phase_end_time_ = SteadyClock::now();
+    step_statistics_.begin_callbacks.Record(phase_end_time_ -
+                                            step_begin_time_);
+  }
+}
+
+void GazeboServer::OnBeforePhysicsUpdate() {
+  const auto now = SteadyClock::now();
+  step_statistics_.world_update.Record(now - phase_end_time_);
+  phase_end_time_ = now;
+}
+
+void GazeboServer::OnWorldUpdateEnd() {
+  const bool collect_step_statistics = config_.collect_step_statistics;
+  if (collect_step_statistics) {
+    step_statistics_.physics.Record(SteadyClock::now() - phase_end_time_);
+  }
+  if (config_.lockstep_real_time_factor > 0) {
+    pacer_.WaitUntil(GetSimulationTime());
+  }
+  SteadyTimestamp end_callbacks_begin_time;
+  if (collect_step_statistics) {
+    end_callbacks_begin_time = SteadyClock::now();
+  }
+  RefreshStateBuffer();
+  if (recorder_.is_open() && ++recorder_step_ % recorder_decimation_ == 0) {
+    RecordState();
+  }
+  if (rollout_ != nullptr) {
+    ++rollout_->step;
+    if (rollout_->step % rollout_->steps_per_command == 0) {
+      const int command = rollout_->step / rollout_->steps_per_command - 1;
+      rollout_->out->states.row(command) = state_buffer_->data().transpose();
+      rollout_->out->simulation_time(command) =
+          std::chrono::duration<double>(
+              state_buffer_->simulation_time().time_since_epoch())
+              .count();
+    }
+  }
+  for (const auto& hook : world_update_end_hooks_) {
+    hook.function();
+  }
+  if (run_for_end_ != nullptr &&
+      (run_for_step_ + 1) % run_for_decimation_ == 0) {
+    (*run_for_end_)();
+  }
+  ++run_for_step_;
+  if (collect_step_statistics) {
+    const auto now = SteadyClock::now();
+    step_statistics_.end_callbacks.Record(now - end_callbacks_begin_time);
+    step_statistics_.step.Record(now - step_begin_time_);
+  }
+}
+
+void GazeboServer::AnchorPacer() {
+  // Deadlines stay absolute across calls, such that the time a control loop
+  // spends between steps is caught up.
+  if (config_.lockstep_real_time_factor > 0 && anchor_pacer_) {
+    pacer_.Anchor(GetSimulationTime());
+    anchor_pacer_ = false;
+  }
+}
+
+void GazeboServer::RefreshStateBuffer() {
+  if (state_buffer_ != nullptr) {
+    ReadState(stepping_async_ ? &async_state_buffer_ : state_buffer_);
+  }
+  if (state_publisher_.is_open()) {
+    ReadState(&state_publisher_buffer_);
+    state_publisher_.Publish(state_publisher_buffer_);
+  }
+}
+
+void GazeboServer::RunSimulationThread() {
+  std::unique_lock<std::mutex> lock(async_mutex_);
+  for (;;) {
+    async_condition_.wait(lock, [this]() {
+      return async_num_steps_ > 0 || stop_simulation_thread_;
+    });
+    if (async_num_steps_ == 0) {
+      break;
+    }
+    const int num_steps = async_num_steps_;
+    lock.unlock();
+
+    stepping_async_ = true;
+    AnchorPacer();
+    gazebo::runWorld(world_, num_steps);
+    stepping_async_ = false;
+    async_state_pending_ = state_buffer_ != nullptr;
+
+    lock.lock();
+    async_num_steps_ = 0;
+    busy_ = false;
+    async_promise_.set_value(true);
+  }
+}
+
+void GazeboServer::CollectAsyncState() {
+  // busy_ is cleared after async_state_pending_ is set, so the flag can be
+  // read once the simulation thread is idle.
+  if (busy_ || !async_state_pending_) {
+    return;
+  }
+  state_buffer_->data_ = async_state_buffer_.data_;
+  state_buffer_->simulation_time_ = async_state_buffer_.simulation_time_;
+  async_state_pending_ = false;
 }
 
 }  // namespace gazebo_server
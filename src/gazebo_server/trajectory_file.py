@@ -0,0 +1,67 @@
+# Copyright 2019 Milan Vukov. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Loads trajectory files written by GazeboServer.start_recording()."""
+
+import struct
+
+import numpy
+
+_MAGIC = b'GZTRAJ01'
+_VERSION = 1
+# magic, version, number of columns, capacity, number of rows, data offset,
+# size of the names block, decimation.
+_HEADER = struct.Struct('<8sIIQQQII')
+
+
+class TrajectoryFile:
+  """Columns of a trajectory file, mapped into memory without copies.
+
+  Columns are read-only NumPy arrays indexed by column name, e.g.
+  trajectory['simulation_time'] or trajectory['chassis/world_p_link/x'].
+  The file stays mapped as long as any column is referenced.
+  """
+
+  def __init__(self, path):
+    with open(path, 'rb') as stream:
+      header = stream.read(_HEADER.size)
+      if len(header) != _HEADER.size:
+        raise ValueError('Got a truncated trajectory file: %s' % path)
+      (magic, version, num_columns, capacity, num_rows, data_offset,
+       names_size, self.decimation) = _HEADER.unpack(header)
+      if magic != _MAGIC or version != _VERSION:
+        raise ValueError('Got an invalid trajectory file: %s' % path)
+      names = stream.read(names_size).decode('utf-8')
+
+    self.names = names.split('\n')[:num_columns]
+    self.num_rows = num_rows
+    data = numpy.memmap(path, dtype='<f8', mode='r', offset=data_offset,
+                        shape=(num_columns, capacity))
+    self.columns = {
+        name: data[column, :num_rows] for column, name in enumerate(self.names)
+    }
+
+  def __getitem__(self, name):
+    return self.columns[name]
+
+  def __len__(self):
+    return self.num_rows
+
+  def matrix(self, names=None):
+    """Stacks columns into a (num_rows, len(names)) array, which is a copy."""
+    names = self.names if names is None else names
+    return numpy.stack([self.columns[name] for name in names], axis=1)
+
+
+def load_trajectory(path):
+  return TrajectoryFile(path)
@@ -0,0 +1,615 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "gazebo_server/gazebo_server_pool.h"
+
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <thread>
+
+#include <Eigen/Geometry>
+#include <gazebo/common/common.hh>
+#include <gazebo/physics/physics.hh>
+
+namespace gazebo_server {
+
+enum class GazeboServerPool::Request : int {
+  kStep,
+  kRunFor,
+  kReset,
+  kEpisode,
+  kShutDown,
+};
+
+namespace {
+
+constexpr int kWaitPeriodMsec = 100;
+constexpr int kShutDownTimeoutMsec = 5000;
+constexpr std::size_t kMaxTrajectoryPathSize = 4096;
+
+// Starts the shared memory, followed by the worker slots, commands, states
+// and per-worker episode parameters and summaries.
+struct alignas(64) SharedHeader {
+  // Posted by a worker whenever it finishes an episode.
+  sem_t episode_done;
+};
+
+timespec GetWaitDeadline() {
+  timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_nsec += kWaitPeriodMsec * 1000000L;
+  deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+  deadline.tv_nsec %= 1000000000L;
+  return deadline;
+}
+
+}  // namespace
+
+struct alignas(64) GazeboServerPool::WorkerSlot {
+  sem_t request_ready;
+  sem_t request_done;
+  Request request;
+  int num_steps;
+  bool success;
+
+  // The episode of a kEpisode request, num_steps is the maximum number of
+  // steps.
+  double init_world_p_body[3];
+  double init_world_rpy_body[3];
+  int seed;
+  char trajectory_path[kMaxTrajectoryPathSize];
+  // The number of steps executed by the worker.
+  int num_episode_steps;
+};
+
+namespace {
+
+// Writes the state of a worker's robot into a row of the state matrix.
+void WriteState(const GazeboServer& server,
+                const std::vector<std::unique_ptr<Link>>& links,
+                const std::vector<std::unique_ptr<Joint>>& joints,
+                double* state) {
+  using std::chrono::duration;
+  *state++ = duration<double>(server.GetSimulationTime().time_since_epoch())
+                 .count();
+
+  Eigen::Vector3d world_p_link;
+  Eigen::Matrix3d world_r_link;
+  for (const auto& link : links) {
+    link->GetWorldPose(&world_p_link, &world_r_link);
+    const Eigen::Quaterniond world_q_link(world_r_link);
+    Eigen::Map<Eigen::Vector3d>{state} = world_p_link;
+    Eigen::Map<Eigen::Vector4d>{state + 3} = world_q_link.coeffs();
+    Eigen::Map<Eigen::Vector3d>{state + 7} = link->GetWorldLinearVel();
+    Eigen::Map<Eigen::Vector3d>{state + 10} = link->GetWorldAngularVel();
+    state += GazeboServerPool::kLinkStateSize;
+  }
+  for (const auto& joint : joints) {
+    state[0] = joint->GetPosition();
+    state[1] = joint->GetVelocity();
+    state += GazeboServerPool::kJointStateSize;
+  }
+}
+
+}  // namespace
+
+bool GazeboServerPool::Config::Validate() const {
+  if (!server_config.Validate()) {
+    return false;
+  }
+  if (num_workers < 1) {
+    std::cerr << "The number of workers must be larger than zero!"
+              << std::endl;
+    return false;
+  }
+  if (base_master_port < 1 || base_master_port + num_workers > 65536) {
+    std::cerr << "Got an invalid base master port!" << std::endl;
+    return false;
+  }
+  if (num_episode_params < 0 || episode_summary_size < 0) {
+    std::cerr << "Got invalid episode parameter or summary sizes!"
+              << std::endl;
+    return false;
+  }
+  for (const auto& name : joint_names) {
+    if (name.empty()) {
+      std::cerr << "Got an empty joint name!" << std::endl;
+      return false;
+    }
+  }
+  for (const auto& name : link_names) {
+    if (name.empty()) {
+      std::cerr << "Got an empty link name!" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+GazeboServerPool::GazeboServerPool(const Config& config) : config_(config) {}
+
+GazeboServerPool::~GazeboServerPool() { ShutDown(); }
+
+bool GazeboServerPool::Start() {
+  if (!config_.Validate()) {
+    return false;
+  }
+  if (shared_memory_ != nullptr) {
+    gzerr << "The pool has been started already!" << std::endl;
+    return false;
+  }
+  if (gazebo::physics::has_world()) {
+    gzerr << "Cannot fork workers from a process which runs a server!"
+          << std::endl;
+    return false;
+  }
+
+  const int num_workers = config_.num_workers;
+  const std::size_t num_commands = num_workers * config_.joint_names.size();
+  const std::size_t num_states = num_workers * state_size();
+  const std::size_t num_episode_values =
+      num_workers *
+      (config_.num_episode_params + config_.episode_summary_size);
+  shared_memory_size_ =
+      sizeof(SharedHeader) + num_workers * sizeof(WorkerSlot) +
+      (num_commands + num_states + num_episode_values) * sizeof(double);
+  shared_memory_ = mmap(nullptr, shared_memory_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared_memory_ == MAP_FAILED) {
+    gzerr << "Failed to allocate shared memory!" << std::endl;
+    shared_memory_ = nullptr;
+    return false;
+  }
+  auto header = new (shared_memory_) SharedHeader();
+  sem_init(&header->episode_done, 1, 0);
+  for (int worker = 0; worker < num_workers; ++worker) {
+    auto worker_slot = new (slot(worker)) WorkerSlot();
+    sem_init(&worker_slot->request_ready, 1, 0);
+    sem_init(&worker_slot->request_done, 1, 0);
+  }
+  commands().setZero();
+
+  std::cout.flush();
+  std::cerr.flush();
+  for (int worker = 0; worker < num_workers; ++worker) {
+    const pid_t pid = fork();
+    if (pid < 0) {
+      gzerr << "Failed to fork worker " << worker << "!" << std::endl;
+      ShutDown();
+      return false;
+    }
+    if (pid == 0) {
+      RunWorker(worker);
+    }
+    worker_pids_.push_back(pid);
+  }
+
+  bool success = true;
+  for (int worker = 0; worker < num_workers; ++worker) {
+    if (!WaitForWorker(worker)) {
+      gzerr << "Failed to start worker " << worker << "!" << std::endl;
+      success = false;
+    }
+  }
+  if (!success) {
+    ShutDown();
+    return false;
+  }
+  initialized_ = true;
+  return true;
+}
+
+bool GazeboServerPool::Step() { return Broadcast(Request::kStep, 1); }
+
+bool GazeboServerPool::RunFor(int num_steps) {
+  if (num_steps < 1) {
+    gzerr << "The number of requested steps must be larger than zero!"
+          << std::endl;
+    return false;
+  }
+  return Broadcast(Request::kRunFor, num_steps);
+}
+
+bool GazeboServerPool::Reset() { return Broadcast(Request::kReset, 0); }
+
+bool GazeboServerPool::Evaluate(const std::vector<EpisodeSpec>& specs,
+                                const EpisodeCallback& on_result) {
+  if (!initialized_) {
+    gzerr << "The pool is not initialized!" << std::endl;
+    return false;
+  }
+  for (const auto& spec : specs) {
+    if (spec.max_num_steps < 1 ||
+        spec.params.size() != config_.num_episode_params ||
+        spec.trajectory_path.size() >= kMaxTrajectoryPathSize) {
+      gzerr << "Got an invalid episode spec!" << std::endl;
+      return false;
+    }
+  }
+
+  // The episode run by each worker, -1 if the worker is idle.
+  std::vector<int> episodes(config_.num_workers, -1);
+  int num_started = 0;
+  int num_running = 0;
+  bool success = true;
+
+  const auto start_next_episode = [&](int worker) {
+    if (num_started < static_cast<int>(specs.size()) &&
+        worker_pids_[worker] > 0) {
+      StartEpisode(worker, specs[num_started]);
+      episodes[worker] = num_started++;
+      ++num_running;
+    }
+  };
+  const auto finish_episode = [&](int worker, int episode,
+                                  bool episode_success) {
+    EpisodeResult result;
+    result.episode = episode;
+    result.worker = worker;
+    result.success = episode_success;
+    if (episode_success) {
+      result.num_steps = slot(worker)->num_episode_steps;
+      result.final_state = states().row(worker).transpose();
+      result.summary = Eigen::Map<const Eigen::VectorXd>(
+          episode_data(worker) + config_.num_episode_params,
+          config_.episode_summary_size);
+    }
+    success = success && episode_success;
+    if (on_result) {
+      on_result(result);
+    }
+  };
+
+  for (int worker = 0; worker < config_.num_workers; ++worker) {
+    start_next_episode(worker);
+  }
+  auto header = static_cast<SharedHeader*>(shared_memory_);
+  while (num_running > 0) {
+    const timespec deadline = GetWaitDeadline();
+    // Several episodes may finish per notification, left over notifications
+    // only cause an extra scan.
+    const bool notified = sem_timedwait(&header->episode_done, &deadline) == 0;
+    for (int worker = 0; worker < config_.num_workers; ++worker) {
+      if (episodes[worker] < 0) continue;
+      const int episode = episodes[worker];
+      if (sem_trywait(&slot(worker)->request_done) == 0) {
+        episodes[worker] = -1;
+        --num_running;
+        finish_episode(worker, episode, slot(worker)->success);
+        start_next_episode(worker);
+      } else if (!notified && !IsWorkerAlive(worker)) {
+        episodes[worker] = -1;
+        --num_running;
+        finish_episode(worker, episode, false);
+      }
+    }
+  }
+
+  if (num_started < static_cast<int>(specs.size())) {
+    gzerr << "All workers have died!" << std::endl;
+    for (; num_started < static_cast<int>(specs.size()); ++num_started) {
+      finish_episode(-1, num_started, false);
+    }
+  }
+  return success;
+}
+
+Eigen::Map<GazeboServerPool::Matrix> GazeboServerPool::commands() {
+  if (shared_memory_ == nullptr) {
+    return Eigen::Map<Matrix>(nullptr, 0, 0);
+  }
+  return Eigen::Map<Matrix>(command_data(), config_.num_workers,
+                            config_.joint_names.size());
+}
+
+Eigen::Map<const GazeboServerPool::Matrix> GazeboServerPool::states() const {
+  if (shared_memory_ == nullptr) {
+    return Eigen::Map<const Matrix>(nullptr, 0, 0);
+  }
+  return Eigen::Map<const Matrix>(state_data(), config_.num_workers,
+                                  state_size());
+}
+
+int GazeboServerPool::state_size() const {
+  return 1 + kLinkStateSize * config_.link_names.size() +
+         kJointStateSize * config_.joint_names.size();
+}
+
+bool GazeboServerPool::Broadcast(Request request, int num_steps) {
+  if (!initialized_) {
+    gzerr << "The pool is not initialized!" << std::endl;
+    return false;
+  }
+  for (int worker = 0; worker < config_.num_workers; ++worker) {
+    auto worker_slot = slot(worker);
+    worker_slot->request = request;
+    worker_slot->num_steps = num_steps;
+    worker_slot->success = false;
+    sem_post(&worker_slot->request_ready);
+  }
+  bool success = true;
+  for (int worker = 0; worker < config_.num_workers; ++worker) {
+    success = WaitForWorker(worker) && success;
+  }
+  return success;
+}
+
+bool GazeboServerPool::WaitForWorker(int worker) {
+  auto worker_slot = slot(worker);
+  for (;;) {
+    const timespec deadline = GetWaitDeadline();
+    if (sem_timedwait(&worker_slot->request_done, &deadline) == 0) {
+      return worker_slot->success;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (!IsWorkerAlive(worker)) {
+      return false;
+    }
+  }
+}
+
+bool GazeboServerPool::IsWorkerAlive(int worker) {
+  if (worker_pids_.at(worker) <= 0 ||
+      waitpid(worker_pids_.at(worker), nullptr, WNOHANG) != 0) {
+    gzerr << "Worker " << worker << " has died!" << std::endl;
+    worker_pids_.at(worker) = -1;
+    return false;
+  }
+  return true;
+}
+
+void GazeboServerPool::StartEpisode(int worker, const EpisodeSpec& spec) {
+  auto worker_slot = slot(worker);
+  worker_slot->request = Request::kEpisode;
+  worker_slot->num_steps = spec.max_num_steps;
+  worker_slot->success = false;
+  Eigen::Map<Eigen::Vector3d>{worker_slot->init_world_p_body} =
+      spec.init_world_p_body;
+  Eigen::Map<Eigen::Vector3d>{worker_slot->init_world_rpy_body} =
+      spec.init_world_rpy_body;
+  worker_slot->seed = spec.seed;
+  const std::size_t path_size =
+      spec.trajectory_path.copy(worker_slot->trajectory_path,
+                                kMaxTrajectoryPathSize - 1);
+  worker_slot->trajectory_path[path_size] = '\0';
+  worker_slot->num_episode_steps = 0;
+  std::copy(spec.params.data(), spec.params.data() + spec.params.size(),
+            episode_data(worker));
+  sem_post(&worker_slot->request_ready);
+}
+
+GazeboServerPool::WorkerSlot* GazeboServerPool::slot(int worker) const {
+  return reinterpret_cast<WorkerSlot*>(
+             static_cast<SharedHeader*>(shared_memory_) + 1) +
+         worker;
+}
+
+double* GazeboServerPool::command_data() const {
+  return reinterpret_cast<double*>(slot(config_.num_workers));
+}
+
+double* GazeboServerPool::state_data() const {
+  return command_data() + config_.num_workers * config_.joint_names.size();
+}
+
+double* GazeboServerPool::episode_data(int worker) const {
+  return state_data() + config_.num_workers * state_size() +
+         worker * (config_.num_episode_params + config_.episode_summary_size);
+}
+
+void GazeboServerPool::RunWorker(int worker) {
+  const std::string master_uri =
+      "http://localhost:" + std::to_string(config_.base_master_port + worker);
+  setenv("GAZEBO_MASTER_URI", master_uri.c_str(), 1);
+
+  auto worker_slot = slot(worker);
+  const int num_joints = config_.joint_names.size();
+  const double* torques = command_data() + worker * num_joints;
+  double* state = state_data() + worker * state_size();
+
+  auto server = std::make_unique<GazeboServer>(config_.server_config);
+  std::vector<std::unique_ptr<Joint>> joints;
+  std::vector<std::unique_ptr<Link>> links;
+  bool success = server->Start();
+  for (const auto& name : config_.joint_names) {
+    if (!success) break;
+    joints.push_back(server->GetJoint(name));
+    success = joints.back() != nullptr;
+  }
+  for (const auto& name : config_.link_names) {
+    if (!success) break;
+    links.push_back(server->GetLink(name));
+    success = links.back() != nullptr;
+  }
+  // Torques are applied at the beginning of every world update.
+  CommandBuffer commands;
+  if (success) {
+    success = server->ResolveCommandBuffer(config_.joint_names, &commands) &&
+              server->SetCommandBuffer(&commands);
+  }
+  if (success && commands.num_joint_axes() != num_joints) {
+    gzerr << "The pool supports only joints with a single axis!" << std::endl;
+    success = false;
+  }
+  std::unique_ptr<EpisodeController> controller;
+  if (success && config_.episode_controller_factory) {
+    controller = config_.episode_controller_factory(server.get());
+    success = controller != nullptr;
+  }
+  if (success) {
+    WriteState(*server, links, joints, state);
+  }
+  worker_slot->success = success;
+  sem_post(&worker_slot->request_done);
+  if (!success) {
+    controller.reset();
+    server.reset();
+    _exit(EXIT_FAILURE);
+  }
+
+  for (;;) {
+    while (sem_wait(&worker_slot->request_ready) != 0) {
+    }
+    const Request request = worker_slot->request;
+    if (request == Request::kShutDown) {
+      break;
+    }
+    switch (request) {
+      case Request::kStep:
+      case Request::kRunFor:
+        commands.effort() =
+            Eigen::Map<const Eigen::VectorXd>(torques, num_joints);
+        success = server->RunFor(worker_slot->num_steps, []() {},
+                                 GazeboServer::Callback());
+        break;
+      case Request::kReset:
+        success = server->Reset();
+        break;
+      case Request::kEpisode:
+        success =
+            RunEpisode(worker, server.get(), controller.get(), &commands);
+        break;
+      default:
+        success = false;
+        break;
+    }
+    WriteState(*server, links, joints, state);
+    worker_slot->success = success;
+    sem_post(&worker_slot->request_done);
+    if (request == Request::kEpisode) {
+      sem_post(&static_cast<SharedHeader*>(shared_memory_)->episode_done);
+    }
+  }
+
+  controller.reset();
+  links.clear();
+  joints.clear();
+  server.reset();
+  _exit(EXIT_SUCCESS);
+}
+
+bool GazeboServerPool::RunEpisode(int worker, GazeboServer* server,
+                                  EpisodeController* controller,
+                                  CommandBuffer* commands) {
+  auto worker_slot = slot(worker);
+  EpisodeSpec spec;
+  spec.init_world_p_body =
+      Eigen::Map<const Eigen::Vector3d>(worker_slot->init_world_p_body);
+  spec.init_world_rpy_body =
+      Eigen::Map<const Eigen::Vector3d>(worker_slot->init_world_rpy_body);
+  spec.seed = worker_slot->seed;
+  spec.max_num_steps = worker_slot->num_steps;
+  spec.params = Eigen::Map<const Eigen::VectorXd>(episode_data(worker),
+                                                  config_.num_episode_params);
+  spec.trajectory_path = worker_slot->trajectory_path;
+
+  GazeboServer::ResetOptions options;
+  options.init_world_p_body = spec.init_world_p_body;
+  options.init_world_rpy_body = spec.init_world_rpy_body;
+  options.seed = spec.seed;
+  if (!server->Reset(options)) {
+    return false;
+  }
+  const bool record = !spec.trajectory_path.empty();
+  if (record && !server->StartRecording(spec.trajectory_path,
+                                        config_.link_names,
+                                        config_.joint_names,
+                                        spec.max_num_steps + 1)) {
+    return false;
+  }
+
+  // Controllers may change the modes and gains of the buffer, the next
+  // request starts from a fresh copy.
+  CommandBuffer episode_commands = *commands;
+  episode_commands.command().setZero();
+  server->SetCommandBuffer(&episode_commands);
+
+  int& num_steps = worker_slot->num_episode_steps;
+  bool success = true;
+  if (controller == nullptr) {
+    success = server->RunFor(spec.max_num_steps, []() {},
+                             GazeboServer::Callback());
+    num_steps = success ? spec.max_num_steps : 0;
+  } else if (controller->BeginEpisode(spec)) {
+    controller->Control(&episode_commands);
+    // The commands of a step are set at the end of the previous one, such
+    // that they are applied from its very beginning.
+    success = server->RunFor(spec.max_num_steps, []() {}, [&]() {
+      ++num_steps;
+      if (controller->IsDone()) {
+        server->EndRun();
+      } else if (num_steps < spec.max_num_steps) {
+        controller->Control(&episode_commands);
+      }
+    });
+    controller->EndEpisode(episode_data(worker) + config_.num_episode_params);
+  } else {
+    success = false;
+  }
+  server->SetCommandBuffer(commands);
+
+  if (record) {
+    success = server->StopRecording() && success;
+  }
+  return success;
+}
+
+void GazeboServerPool::ShutDown() {
+  initialized_ = false;
+  for (std::size_t worker = 0; worker < worker_pids_.size(); ++worker) {
+    if (worker_pids_[worker] <= 0) continue;
+    auto worker_slot = slot(worker);
+    worker_slot->request = Request::kShutDown;
+    sem_post(&worker_slot->request_ready);
+  }
+  for (auto pid : worker_pids_) {
+    if (pid <= 0) continue;
+    int elapsed_msec = 0;
+    while (waitpid(pid, nullptr, WNOHANG) == 0) {
+      if (elapsed_msec >= kShutDownTimeoutMsec) {
+        std::cerr << "Killing unresponsive worker " << pid << "!" << std::endl;
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(kWaitPeriodMsec));
+      elapsed_msec += kWaitPeriodMsec;
+    }
+  }
+  worker_pids_.clear();
+
+  if (shared_memory_ != nullptr) {
+    sem_destroy(&static_cast<SharedHeader*>(shared_memory_)->episode_done);
+    for (int worker = 0; worker < config_.num_workers; ++worker) {
+      sem_destroy(&slot(worker)->request_ready);
+      sem_destroy(&slot(worker)->request_done);
+    }
+    munmap(shared_memory_, shared_memory_size_);
+    shared_memory_ = nullptr;
+  }
+}
+
+}  // namespace gazebo_server
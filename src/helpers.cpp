@@ -56,4 +56,23 @@ std::string GetRobotName(const std::string& model_sdf_xml) {
   return std::string(model_element->Attribute("name"));
 }
 
+std::string SetRobotName(const std::string& model_sdf_xml,
+                         const std::string& robot_name) {
+  TiXmlDocument model_doc;
+  model_doc.Parse(model_sdf_xml.c_str());
+  TiXmlElement* sdf_element = model_doc.FirstChildElement("sdf");
+  TiXmlElement* model_element =
+      sdf_element ? sdf_element->FirstChildElement("model") : nullptr;
+  if (!model_element) {
+    std::cerr << "Got an invalid SDF XML (no sdf and/or model tag)!"
+              << std::endl;
+    return std::string();
+  }
+  model_element->SetAttribute("name", robot_name.c_str());
+
+  TiXmlPrinter xml_printer;
+  model_doc.Accept(&xml_printer);
+  return xml_printer.Str();
+}
+
 }  // namespace gazebo_server
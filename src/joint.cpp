@@ -13,21 +13,72 @@
 // limitations under the License.
 #include "gazebo_server/joint.h"
 
+#include <limits>
+
+#include <gazebo/common/Console.hh>
 #include <gazebo/physics/Joint.hh>
 
 namespace gazebo_server {
 namespace {
 
-constexpr int kAxis = 0;
+constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
 
 }  // namespace
 
-void Joint::SetTorque(double torque) { joint_->SetForce(kAxis, torque); }
+unsigned int Joint::DOF() const { return joint_->DOF(); }
+
+bool Joint::SetTorque(double torque, unsigned int axis) {
+  if (!IsValidAxis(axis)) return false;
+  joint_->SetForce(axis, torque);
+  return true;
+}
+
+double Joint::GetTorque(unsigned int axis) const {
+  return IsValidAxis(axis) ? joint_->GetForce(axis) : kNaN;
+}
+
+double Joint::GetVelocity(unsigned int axis) const {
+  return IsValidAxis(axis) ? joint_->GetVelocity(axis) : kNaN;
+}
+
+double Joint::GetPosition(unsigned int axis) const {
+  return IsValidAxis(axis) ? joint_->Position(axis) : kNaN;
+}
+
+bool Joint::SetPosition(double position, unsigned int axis) {
+  if (!IsValidAxis(axis)) return false;
+  return joint_->SetPosition(axis, position);
+}
+
+bool Joint::SetVelocity(double velocity, unsigned int axis) {
+  if (!IsValidAxis(axis)) return false;
+  joint_->SetVelocity(axis, velocity);
+  return true;
+}
+
+double Joint::GetLowerLimit(unsigned int axis) const {
+  return IsValidAxis(axis) ? joint_->LowerLimit(axis) : kNaN;
+}
+
+double Joint::GetUpperLimit(unsigned int axis) const {
+  return IsValidAxis(axis) ? joint_->UpperLimit(axis) : kNaN;
+}
 
-double Joint::GetTorque() const { return joint_->GetForce(kAxis); }
+double Joint::GetEffortLimit(unsigned int axis) const {
+  return IsValidAxis(axis) ? joint_->GetEffortLimit(axis) : kNaN;
+}
 
-double Joint::GetVelocity() const { return joint_->GetVelocity(kAxis); }
+double Joint::GetVelocityLimit(unsigned int axis) const {
+  return IsValidAxis(axis) ? joint_->GetVelocityLimit(axis) : kNaN;
+}
 
-double Joint::GetPosition() const { return joint_->Position(kAxis); }
+bool Joint::IsValidAxis(unsigned int axis) const {
+  if (axis >= joint_->DOF()) {
+    gzerr << "Joint " << joint_->GetScopedName() << " has no axis " << axis
+          << "!" << std::endl;
+    return false;
+  }
+  return true;
+}
 
 }  // namespace gazebo_server
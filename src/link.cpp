@@ -16,6 +16,8 @@
 #include <Eigen/Geometry>
 #include <gazebo/physics/Link.hh>
 
+#include "gazebo_server/helpers.h"
+
 namespace gazebo_server {
 
 using Eigen::Matrix3d;
@@ -33,6 +35,12 @@ void Link::GetWorldPose(Vector3d* world_p_link, Matrix3d* world_r_link) const {
                               world_t_link.Rot().Y(), world_t_link.Rot().Z())
                       .toRotationMatrix();
 }
+
+void Link::SetWorldPose(const Vector3d& world_p_link,
+                        const Matrix3d& world_r_link) {
+  link_->SetWorldPose(ToPose(world_p_link, world_r_link));
+}
+
 Vector3d Link::GetWorldLinearVel() const {
   const auto ret = link_->WorldLinearVel();
   return Vector3d(ret.X(), ret.Y(), ret.Z());
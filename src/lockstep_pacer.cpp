@@ -0,0 +1,57 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "gazebo_server/lockstep_pacer.h"
+
+#include <thread>
+
+namespace gazebo_server {
+
+void LockstepPacer::Anchor(SteadyTimestamp simulation_time) {
+  anchor_wall_time_ = SteadyClock::now();
+  anchor_simulation_time_ = simulation_time;
+}
+
+void LockstepPacer::WaitUntil(SteadyTimestamp simulation_time) {
+  const auto deadline = GetDeadline(simulation_time);
+  const auto now = SteadyClock::now();
+  if (now > deadline) {
+    const auto overrun = now - deadline;
+    statistics_.overrun.Record(overrun);
+    if (overrun > max_lag_) {
+      Anchor(simulation_time);
+      statistics_.num_reanchors.store(
+          statistics_.num_reanchors.load(std::memory_order_relaxed) + 1,
+          std::memory_order_relaxed);
+    }
+    return;
+  }
+
+  statistics_.slack.Record(deadline - now);
+  if (deadline - now > spin_duration_) {
+    std::this_thread::sleep_until(deadline - spin_duration_);
+  }
+  while (SteadyClock::now() < deadline) {
+  }
+}
+
+SteadyTimestamp LockstepPacer::GetDeadline(
+    SteadyTimestamp simulation_time) const {
+  const std::chrono::duration<double> elapsed_simulation_time =
+      simulation_time - anchor_simulation_time_;
+  return anchor_wall_time_ +
+         std::chrono::duration_cast<SteadyClock::duration>(
+             elapsed_simulation_time / real_time_factor_);
+}
+
+}  // namespace gazebo_server
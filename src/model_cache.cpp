@@ -0,0 +1,151 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "gazebo_server/model_cache.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <sdf/sdf.hh>
+#include <tinyxml.h>
+
+#include "gazebo_server/helpers.h"
+
+namespace gazebo_server {
+namespace {
+
+// Bump on changes of the entry format or of DescribeModel().
+constexpr char kEntryHeader[] = "gazebo_server_model_cache 2";
+
+}  // namespace
+
+bool DescribeModel(const std::string& model_xml,
+                   ModelDescription* description) {
+  TiXmlDocument model_doc;
+  model_doc.Parse(model_xml.c_str());
+  if (model_doc.FirstChildElement("robot")) {
+    description->sdf_xml = UrdfToSdf(model_xml);
+    if (description->sdf_xml.empty()) {
+      return false;
+    }
+  } else {
+    description->sdf_xml = model_xml;
+  }
+  description->robot_name = GetRobotName(description->sdf_xml);
+  return !description->robot_name.empty();
+}
+
+bool ValidateModel(const ModelDescription& description) {
+  sdf::SDFPtr sdf_root(new sdf::SDF());
+  sdf::init(sdf_root);
+  if (!sdf::readString(description.sdf_xml, sdf_root)) {
+    std::cerr << "Got an invalid SDF XML for model " << description.robot_name
+              << "!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ModelCache::Load(const std::string& model_xml,
+                      ModelDescription* description) {
+  const auto path = GetEntryPath(model_xml);
+  if (Read(path, model_xml, description)) {
+    ++num_hits_;
+    return true;
+  }
+  ++num_misses_;
+  if (!DescribeModel(model_xml, description) || !ValidateModel(*description)) {
+    return false;
+  }
+  if (!Write(path, model_xml, *description)) {
+    std::cerr << "Failed to write model cache entry " << path << "!"
+              << std::endl;
+  }
+  return true;
+}
+
+std::string ModelCache::GetEntryPath(const std::string& model_xml) const {
+  std::ostringstream sstream;
+  sstream << directory_ << "/" << std::hex << std::setw(16)
+          << std::setfill('0') << GetKey(model_xml) << ".model";
+  return sstream.str();
+}
+
+std::uint64_t ModelCache::Hash(const std::string& data, std::uint64_t hash) {
+  for (const char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+std::uint64_t ModelCache::GetKey(const std::string& model_xml) {
+  // Converted XMLs depend on the SDFormat version.
+  return Hash(model_xml, Hash(SDF_VERSION_FULL));
+}
+
+bool ModelCache::Read(const std::string& path, const std::string& model_xml,
+                      ModelDescription* description) const {
+  std::ifstream stream(path.c_str(), std::ios::binary);
+  if (!stream) {
+    return false;
+  }
+  // The hash and the size of the model XML guard against hash collisions.
+  std::string header;
+  std::uint64_t hash = 0;
+  std::size_t model_xml_size = 0;
+  if (!std::getline(stream, header) || header != kEntryHeader ||
+      !(stream >> std::hex >> hash >> std::dec >> model_xml_size) ||
+      hash != GetKey(model_xml) || model_xml_size != model_xml.size() ||
+      stream.get() != '\n' || !std::getline(stream, description->robot_name)) {
+    return false;
+  }
+  std::size_t sdf_xml_size = 0;
+  if (!(stream >> sdf_xml_size) || stream.get() != '\n') {
+    return false;
+  }
+  description->sdf_xml.resize(sdf_xml_size);
+  stream.read(&description->sdf_xml[0], sdf_xml_size);
+  return static_cast<bool>(stream);
+}
+
+bool ModelCache::Write(const std::string& path, const std::string& model_xml,
+                       const ModelDescription& description) const {
+  // Writing to a temporary file and renaming it makes concurrent readers
+  // see either no entry or a complete one.
+  const std::string tmp_path = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream stream(tmp_path.c_str(), std::ios::binary);
+    stream << kEntryHeader << '\n'
+           << std::hex << GetKey(model_xml) << std::dec << ' '
+           << model_xml.size() << '\n'
+           << description.robot_name << '\n'
+           << description.sdf_xml.size() << '\n' << description.sdf_xml;
+    if (!stream.flush()) {
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace gazebo_server
@@ -11,6 +11,13 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <tuple>
 
 #include <pybind11/chrono.h>
@@ -19,24 +26,115 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include "gazebo_server/command_buffer.h"
 #include "gazebo_server/gazebo_server.h"
+#include "gazebo_server/gazebo_server_pool.h"
 #include "gazebo_server/helpers.h"
 #include "gazebo_server/joint.h"
 #include "gazebo_server/link.h"
+#include "gazebo_server/lockstep_pacer.h"
+#include "gazebo_server/model_cache.h"
+#include "gazebo_server/state_buffer.h"
+#include "gazebo_server/state_publisher.h"
+#include "gazebo_server/state_snapshot.h"
+#include "gazebo_server/step_statistics.h"
+#include "gazebo_server/trajectory.h"
+#include "gazebo_server/trajectory_recorder.h"
 
 namespace py = pybind11;
 using namespace pybind11::literals;
 
 namespace gazebo_server {
+namespace {
+
+// Raises IndexError for axes the joint doesn't have.
+void CheckAxis(const Joint& joint, unsigned int axis) {
+  if (axis >= joint.DOF()) {
+    throw std::out_of_range("Got an invalid joint axis!");
+  }
+}
+
+}  // namespace
 
 PYBIND11_MODULE(py_gazebo_server, m) {
   m.doc() = "Gazebo server Python bindings";
 
+  // Joints and links are views on the simulation, the bindings returning them
+  // keep the server alive.
   py::class_<Joint>(m, "Joint")
-      .def("get_torque", &Joint::GetTorque)
-      .def("set_torque", &Joint::SetTorque, "torque"_a)
-      .def("get_velocity", &Joint::GetVelocity)
-      .def("get_position", &Joint::GetPosition);
+      .def_property_readonly("dof", &Joint::DOF)
+      .def(
+          "get_torque",
+          [](const Joint& self, unsigned int axis) {
+            CheckAxis(self, axis);
+            return self.GetTorque(axis);
+          },
+          "axis"_a = 0)
+      .def(
+          "set_torque",
+          [](Joint& self, double torque, unsigned int axis) {
+            CheckAxis(self, axis);
+            self.SetTorque(torque, axis);
+          },
+          "torque"_a, "axis"_a = 0)
+      .def(
+          "get_velocity",
+          [](const Joint& self, unsigned int axis) {
+            CheckAxis(self, axis);
+            return self.GetVelocity(axis);
+          },
+          "axis"_a = 0)
+      .def(
+          "get_position",
+          [](const Joint& self, unsigned int axis) {
+            CheckAxis(self, axis);
+            return self.GetPosition(axis);
+          },
+          "axis"_a = 0)
+      .def(
+          "set_position",
+          [](Joint& self, double position, unsigned int axis) {
+            CheckAxis(self, axis);
+            if (!self.SetPosition(position, axis)) {
+              throw std::runtime_error("Failed to set the joint position!");
+            }
+          },
+          "position"_a, "axis"_a = 0)
+      .def(
+          "set_velocity",
+          [](Joint& self, double velocity, unsigned int axis) {
+            CheckAxis(self, axis);
+            self.SetVelocity(velocity, axis);
+          },
+          "velocity"_a, "axis"_a = 0)
+      .def(
+          "get_lower_limit",
+          [](const Joint& self, unsigned int axis) {
+            CheckAxis(self, axis);
+            return self.GetLowerLimit(axis);
+          },
+          "axis"_a = 0)
+      .def(
+          "get_upper_limit",
+          [](const Joint& self, unsigned int axis) {
+            CheckAxis(self, axis);
+            return self.GetUpperLimit(axis);
+          },
+          "axis"_a = 0)
+      .def(
+          "get_effort_limit",
+          [](const Joint& self, unsigned int axis) {
+            CheckAxis(self, axis);
+            return self.GetEffortLimit(axis);
+          },
+          "axis"_a = 0)
+      .def(
+          "get_velocity_limit",
+          [](const Joint& self, unsigned int axis) {
+            CheckAxis(self, axis);
+            return self.GetVelocityLimit(axis);
+          },
+          "axis"_a = 0);
 
   py::class_<Link>(m, "Link")
       .def(
@@ -55,10 +153,129 @@ PYBIND11_MODULE(py_gazebo_server, m) {
       .def("get_relative_linear_vel", &Link::GetRelativeLinearVel)
       .def("get_relative_linear_accel", &Link::GetRelativeLinearAccel)
       .def("get_relative_angular_vel", &Link::GetRelativeAngularVel)
-      .def("get_relative_angular_accel", &Link::GetRelativeAngularAccel);
+      .def("get_relative_angular_accel", &Link::GetRelativeAngularAccel)
+      .def("set_world_pose", &Link::SetWorldPose, "world_p_link"_a,
+           "world_r_link"_a);
+
+  py::enum_<ControlMode>(m, "ControlMode")
+      .value("EFFORT", ControlMode::kEffort)
+      .value("POSITION", ControlMode::kPosition)
+      .value("VELOCITY", ControlMode::kVelocity);
+
+  py::class_<CommandBuffer>(m, "CommandBuffer")
+      .def_property_readonly("num_joint_axes", &CommandBuffer::num_joint_axes)
+      .def_property_readonly("joint_names", &CommandBuffer::joint_names)
+      .def_property_readonly(
+          "command", [](CommandBuffer& self) { return self.command(); },
+          py::return_value_policy::reference_internal,
+          "Commands, one per joint axis. A writable view on the buffer.")
+      .def_property_readonly(
+          "effort", [](CommandBuffer& self) { return self.effort(); },
+          py::return_value_policy::reference_internal,
+          "Efforts, one per joint axis. A writable view on the buffer.")
+      .def("mode", &CommandBuffer::mode, "index"_a)
+      .def("set_mode",
+           py::overload_cast<int, ControlMode>(&CommandBuffer::set_mode),
+           "index"_a, "mode"_a)
+      .def("set_mode", py::overload_cast<ControlMode>(&CommandBuffer::set_mode),
+           "mode"_a)
+      .def_property_readonly(
+          "kp", [](CommandBuffer& self) { return self.kp(); },
+          py::return_value_policy::reference_internal)
+      .def_property_readonly(
+          "kd", [](CommandBuffer& self) { return self.kd(); },
+          py::return_value_policy::reference_internal)
+      .def_property_readonly(
+          "effort_limit",
+          [](CommandBuffer& self) { return self.effort_limit(); },
+          py::return_value_policy::reference_internal);
+
+  // The array properties are read-only views on the buffer memory. They are
+  // refreshed in place by the server, see GazeboServer.set_state_buffer.
+  py::class_<StateBuffer>(m, "StateBuffer")
+      .def_property_readonly("num_links", &StateBuffer::num_links)
+      .def_property_readonly("num_joint_axes", &StateBuffer::num_joint_axes)
+      .def_property_readonly("link_names", &StateBuffer::link_names)
+      .def_property_readonly("joint_names", &StateBuffer::joint_names)
+      .def_property_readonly("simulation_time",
+                             &StateBuffer::simulation_time)
+      .def_property_readonly("world_p_link", &StateBuffer::world_p_link,
+                             py::return_value_policy::reference_internal)
+      .def_property_readonly("world_q_link", &StateBuffer::world_q_link,
+                             py::return_value_policy::reference_internal)
+      .def_property_readonly("world_v_link", &StateBuffer::world_v_link,
+                             py::return_value_policy::reference_internal)
+      .def_property_readonly("world_w_link", &StateBuffer::world_w_link,
+                             py::return_value_policy::reference_internal)
+      .def_property_readonly("joint_position", &StateBuffer::joint_position,
+                             py::return_value_policy::reference_internal)
+      .def_property_readonly("joint_velocity", &StateBuffer::joint_velocity,
+                             py::return_value_policy::reference_internal)
+      .def_property_readonly("joint_effort", &StateBuffer::joint_effort,
+                             py::return_value_policy::reference_internal)
+      .def_property_readonly("data", &StateBuffer::data,
+                             py::return_value_policy::reference_internal);
+
+  py::class_<Trajectory>(m, "Trajectory")
+      .def(py::init<>())
+      .def_readonly("simulation_time", &Trajectory::simulation_time)
+      .def_readonly("states", &Trajectory::states);
+
+  py::class_<StateSnapshot>(m, "StateSnapshot")
+      .def(py::init<>())
+      .def("empty", &StateSnapshot::empty)
+      .def_property_readonly("size_in_bytes", &StateSnapshot::size_in_bytes)
+      .def_property_readonly("simulation_time",
+                             &StateSnapshot::simulation_time);
+
+  py::class_<LatencyHistogram>(m, "LatencyHistogram")
+      .def_property_readonly("count", &LatencyHistogram::count)
+      .def_property_readonly("min", &LatencyHistogram::min)
+      .def_property_readonly("max", &LatencyHistogram::max)
+      .def_property_readonly("mean", &LatencyHistogram::mean)
+      .def_property_readonly("total", &LatencyHistogram::total)
+      .def("get_percentile", &LatencyHistogram::GetPercentile, "percentile"_a);
+
+  py::class_<StepStatistics>(m, "StepStatistics")
+      .def_readonly("begin_callbacks", &StepStatistics::begin_callbacks)
+      .def_readonly("world_update", &StepStatistics::world_update)
+      .def_readonly("physics", &StepStatistics::physics)
+      .def_readonly("end_callbacks", &StepStatistics::end_callbacks)
+      .def_readonly("step", &StepStatistics::step);
+
+  py::class_<PacingStatistics>(m, "PacingStatistics")
+      .def_readonly("slack", &PacingStatistics::slack)
+      .def_readonly("overrun", &PacingStatistics::overrun)
+      .def_property_readonly("num_reanchors",
+                             [](const PacingStatistics& self) {
+                               return self.num_reanchors.load();
+                             });
+
+  py::class_<StepFuture>(m, "StepFuture")
+      .def("done",
+           [](const StepFuture& self) {
+             return self.wait_for(std::chrono::seconds(0)) ==
+                    std::future_status::ready;
+           })
+      .def(
+          "result",
+          [](const StepFuture& self) {
+            py::gil_scoped_release release;
+            return self.get();
+          },
+          "Waits for the steps and updates the state buffer of the server.");
 
   py::class_<GazeboServer> server(m, "GazeboServer");
 
+  py::class_<GazeboServer::ModelConfig>(server, "ModelConfig")
+      .def(py::init<>())
+      .def_readwrite("sdf_xml", &GazeboServer::ModelConfig::sdf_xml)
+      .def_readwrite("name", &GazeboServer::ModelConfig::name)
+      .def_readwrite("init_world_p_body",
+                     &GazeboServer::ModelConfig::init_world_p_body)
+      .def_readwrite("init_world_rpy_body",
+                     &GazeboServer::ModelConfig::init_world_rpy_body);
+
   py::class_<GazeboServer::Config>(server, "Config")
       .def(py::init<>())
       .def("validate", &GazeboServer::Config::Validate)
@@ -66,27 +283,73 @@ PYBIND11_MODULE(py_gazebo_server, m) {
       .def_readwrite("model_paths", &GazeboServer::Config::model_paths)
       .def_readwrite("world_path", &GazeboServer::Config::world_path)
       .def_readwrite("model_sdf_xml", &GazeboServer::Config::model_sdf_xml)
+      .def_readwrite("model_cache_path",
+                     &GazeboServer::Config::model_cache_path)
       .def_readwrite("init_world_p_body",
                      &GazeboServer::Config::init_world_p_body)
       .def_readwrite("init_world_rpy_body",
                      &GazeboServer::Config::init_world_rpy_body)
+      .def_readwrite("additional_models",
+                     &GazeboServer::Config::additional_models)
       .def_readwrite("verbose", &GazeboServer::Config::verbose)
       .def_readwrite("seed", &GazeboServer::Config::seed)
       .def_readwrite("enable_physics_engine",
                      &GazeboServer::Config::enable_physics_engine)
       .def_readwrite("real_time_update_rate",
-                     &GazeboServer::Config::real_time_update_rate);
+                     &GazeboServer::Config::real_time_update_rate)
+      .def_readwrite("lockstep_real_time_factor",
+                     &GazeboServer::Config::lockstep_real_time_factor)
+      .def_readwrite("lockstep_spin_duration",
+                     &GazeboServer::Config::lockstep_spin_duration)
+      .def_readwrite("lockstep_max_lag",
+                     &GazeboServer::Config::lockstep_max_lag)
+      .def_readwrite("fast_reset", &GazeboServer::Config::fast_reset)
+      .def_readwrite("collect_step_statistics",
+                     &GazeboServer::Config::collect_step_statistics);
+
+  py::class_<GazeboServer::ResetOptions>(server, "ResetOptions")
+      .def(py::init<>())
+      .def_readwrite("init_world_p_body",
+                     &GazeboServer::ResetOptions::init_world_p_body)
+      .def_readwrite("init_world_rpy_body",
+                     &GazeboServer::ResetOptions::init_world_rpy_body)
+      .def_readwrite("seed", &GazeboServer::ResetOptions::seed)
+      .def_readwrite("joint_positions",
+                     &GazeboServer::ResetOptions::joint_positions)
+      .def_readwrite("joint_velocities",
+                     &GazeboServer::ResetOptions::joint_velocities)
+      .def_readwrite("link_masses", &GazeboServer::ResetOptions::link_masses)
+      .def_readwrite("link_frictions",
+                     &GazeboServer::ResetOptions::link_frictions);
+
+  py::class_<GazeboServer::StartupTimings>(server, "StartupTimings")
+      .def_readonly("describe_models",
+                    &GazeboServer::StartupTimings::describe_models)
+      .def_readonly("setup_server",
+                    &GazeboServer::StartupTimings::setup_server)
+      .def_readonly("load_world", &GazeboServer::StartupTimings::load_world)
+      .def_readonly("insert_model",
+                    &GazeboServer::StartupTimings::insert_model)
+      .def_readonly("total", &GazeboServer::StartupTimings::total)
+      .def_readonly("num_insertion_steps",
+                    &GazeboServer::StartupTimings::num_insertion_steps);
 
   server.def(py::init<const GazeboServer::Config&>())
       .def("start", &GazeboServer::Start)
       .def("step", &GazeboServer::Step)
+      .def(
+          "step_async",
+          [](GazeboServer& self, int num_steps) {
+            return self.StepAsync(num_steps);
+          },
+          "num_steps"_a = 1, py::keep_alive<0, 1>())
       .def(
           "run_for",
           [](GazeboServer& self, int num_steps,
              GazeboServer::Callback on_world_update_begin,
-             GazeboServer::Callback* on_world_update_end) {
+             GazeboServer::Callback* on_world_update_end, int decimation) {
             return self.RunFor(
-                num_steps,
+                num_steps, decimation,
                 [&on_world_update_begin]() { on_world_update_begin(); },
                 [on_world_update_end]() {
                   if (on_world_update_end != nullptr) {
@@ -94,10 +357,177 @@ PYBIND11_MODULE(py_gazebo_server, m) {
                   }
                 });
           },
-          "num_steps"_a, "on_world_update_begin"_a, "on_world_update_end"_a)
-      .def("reset", &GazeboServer::Reset)
+          "num_steps"_a, "on_world_update_begin"_a, "on_world_update_end"_a,
+          "decimation"_a = 1,
+          "Runs the simulation, calling the callbacks at the beginning and "
+          "at the end of every decimation steps, see GazeboServer::RunFor.")
+      .def(
+          "run_for_without_gil",
+          [](GazeboServer& self, int num_steps, int callback_period,
+             const py::object& callback, StateBuffer* state) {
+            if (callback_period < 0) {
+              throw py::value_error("callback_period must be >= 0!");
+            }
+            const bool has_callback =
+                callback_period > 0 && !callback.is_none();
+            using RowMajorMatrixXd =
+                Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic,
+                              Eigen::RowMajor>;
+            RowMajorMatrixXd states(
+                state != nullptr ? std::max(num_steps, 0) : 0,
+                state != nullptr ? state->data().size() : 0);
+            // Without recording, the end callback is needed only at the end
+            // of callback periods.
+            const int decimation =
+                has_callback && state == nullptr ? callback_period : 1;
+            int step = 0;
+            std::exception_ptr callback_error;
+            bool success;
+            {
+              py::gil_scoped_release release;
+              success = self.RunFor(
+                  num_steps, decimation, []() {},
+                  [&]() {
+                    if (state != nullptr) {
+                      self.ReadState(state);
+                      states.row(step) = state->data().transpose();
+                    }
+                    step += decimation;
+                    if (has_callback && !callback_error &&
+                        step % callback_period == 0) {
+                      py::gil_scoped_acquire acquire;
+                      try {
+                        callback();
+                      } catch (...) {
+                        // Skips the remaining steps, the error is raised
+                        // once the run ends.
+                        callback_error = std::current_exception();
+                        self.EndRun();
+                      }
+                    }
+                  });
+            }
+            if (callback_error) {
+              std::rethrow_exception(callback_error);
+            }
+            if (!success) {
+              throw std::runtime_error("Failed to run the simulation!");
+            }
+            return states;
+          },
+          "num_steps"_a, "callback_period"_a = 0, "callback"_a = py::none(),
+          "state"_a = nullptr,
+          "Runs the simulation without holding the GIL.\n\n"
+          "Joint efforts are taken from the command buffer set by "
+          "set_command_buffer. The callback, if any, is called at the end "
+          "of every callback_period-th step; it may update the command "
+          "buffer. If it raises, the run ends right away and the error is "
+          "propagated. If a state buffer is given, it's recorded after every "
+          "step. Returns a (num_steps x state.data.size) array of the "
+          "recorded states.")
+      .def(
+          "rollout",
+          [](GazeboServer& self, const Eigen::MatrixXd& joint_commands,
+             int steps_per_command, Trajectory* trajectory) {
+            py::object result =
+                trajectory != nullptr
+                    ? py::cast(trajectory, py::return_value_policy::reference)
+                    : py::cast(Trajectory());
+            auto& out = result.cast<Trajectory&>();
+            bool success;
+            {
+              py::gil_scoped_release release;
+              success = self.Rollout(joint_commands, steps_per_command, &out);
+            }
+            if (!success) {
+              throw std::runtime_error("Failed to run the rollout!");
+            }
+            return result;
+          },
+          "joint_commands"_a, "steps_per_command"_a,
+          "trajectory"_a = nullptr,
+          "Runs a (num_commands x num_joint_axes) sequence of commands, "
+          "see GazeboServer::Rollout. Reuses the trajectory if given, "
+          "otherwise returns a new one.")
+      .def("reset", py::overload_cast<>(&GazeboServer::Reset))
+      .def("reset",
+           py::overload_cast<const GazeboServer::ResetOptions&>(
+               &GazeboServer::Reset),
+           "options"_a)
+      .def(
+          "save_state",
+          [](GazeboServer& self) {
+            StateSnapshot snapshot;
+            if (!self.SaveState(&snapshot)) {
+              throw std::runtime_error("Failed to save state!");
+            }
+            return snapshot;
+          },
+          "Returns a new snapshot of the simulation state.")
+      .def("save_state", &GazeboServer::SaveState, "snapshot"_a,
+           "Saves the simulation state into an existing snapshot.")
+      .def("restore_state", &GazeboServer::RestoreState, "snapshot"_a)
+      .def(
+          "resolve_state_buffer",
+          [](const GazeboServer& self,
+             const std::vector<std::string>& link_names,
+             const std::vector<std::string>& joint_names) {
+            StateBuffer buffer;
+            if (!self.ResolveStateBuffer(link_names, joint_names, &buffer)) {
+              throw std::runtime_error("Failed to resolve state buffer!");
+            }
+            return buffer;
+          },
+          "link_names"_a, "joint_names"_a)
+      .def("read_state", &GazeboServer::ReadState, "buffer"_a)
+      .def("set_state_buffer", &GazeboServer::SetStateBuffer, "buffer"_a,
+           py::keep_alive<1, 2>())
+      .def(
+          "resolve_command_buffer",
+          [](const GazeboServer& self,
+             const std::vector<std::string>& joint_names) {
+            CommandBuffer buffer;
+            if (!self.ResolveCommandBuffer(joint_names, &buffer)) {
+              throw std::runtime_error("Failed to resolve command buffer!");
+            }
+            return buffer;
+          },
+          "joint_names"_a)
+      .def("set_command_buffer", &GazeboServer::SetCommandBuffer, "buffer"_a,
+           py::keep_alive<1, 2>())
+      .def("open_state_publisher", &GazeboServer::OpenStatePublisher,
+           "name"_a, "link_names"_a, "joint_names"_a, "num_slots"_a = 64)
+      .def("close_state_publisher", &GazeboServer::CloseStatePublisher)
+      .def("start_recording", &GazeboServer::StartRecording, "path"_a,
+           "link_names"_a, "joint_names"_a, "max_num_samples"_a,
+           "decimation"_a = 1)
+      .def("stop_recording", &GazeboServer::StopRecording)
+      .def_property_readonly("recorder", &GazeboServer::recorder,
+                             py::return_value_policy::reference_internal)
+      .def("reset_to_initial_state", &GazeboServer::ResetToInitialState)
+      .def("set_robot_pose",
+           py::overload_cast<const Eigen::Vector3d&, const Eigen::Matrix3d&>(
+               &GazeboServer::SetRobotPose),
+           "world_p_body"_a, "world_r_body"_a)
+      .def("set_robot_pose",
+           py::overload_cast<const std::string&, const Eigen::Vector3d&,
+                             const Eigen::Matrix3d&>(
+               &GazeboServer::SetRobotPose),
+           "robot_name"_a, "world_p_body"_a, "world_r_body"_a)
+      .def_property_readonly("robot_names", &GazeboServer::robot_names)
       .def_property_readonly("simulation_time",
                              &GazeboServer::GetSimulationTime)
+      .def_property_readonly("startup_timings",
+                             &GazeboServer::startup_timings)
+      .def_property_readonly("step_statistics",
+                             &GazeboServer::step_statistics,
+                             py::return_value_policy::reference_internal)
+      .def("clear_step_statistics", &GazeboServer::ClearStepStatistics)
+      .def_property_readonly("pacing_statistics",
+                             &GazeboServer::pacing_statistics,
+                             py::return_value_policy::reference_internal)
+      .def("clear_pacing_statistics", &GazeboServer::ClearPacingStatistics)
+      .def("resume_pacing", &GazeboServer::ResumePacing)
 
       .def(
           "get_joint",
@@ -108,7 +538,7 @@ PYBIND11_MODULE(py_gazebo_server, m) {
             }
             return joint;
           },
-          "name"_a)
+          "name"_a, py::keep_alive<0, 1>())
 
       .def(
           "get_link",
@@ -119,9 +549,153 @@ PYBIND11_MODULE(py_gazebo_server, m) {
             }
             return link;
           },
-          "name"_a);
+          "name"_a, py::keep_alive<0, 1>())
+
+      .def("link_index", &GazeboServer::LinkIndex, "name"_a,
+           "Returns the index of a link for get_link_at(), -1 if the name "
+           "is invalid.")
+      .def("joint_index", &GazeboServer::JointIndex, "name"_a,
+           "Returns the index of a joint for get_joint_at(), -1 if the name "
+           "is invalid.")
+      .def(
+          "get_link_at",
+          [](const GazeboServer& self, int index) {
+            if (index < 0 ||
+                index >= static_cast<int>(self.link_names().size())) {
+              throw std::out_of_range("Got an invalid link index!");
+            }
+            return self.GetLinkAt(index);
+          },
+          "index"_a, py::keep_alive<0, 1>())
+      .def(
+          "get_joint_at",
+          [](const GazeboServer& self, int index) {
+            if (index < 0 ||
+                index >= static_cast<int>(self.joint_names().size())) {
+              throw std::out_of_range("Got an invalid joint index!");
+            }
+            return self.GetJointAt(index);
+          },
+          "index"_a, py::keep_alive<0, 1>())
+      .def_property_readonly("link_names", &GazeboServer::link_names)
+      .def_property_readonly("joint_names", &GazeboServer::joint_names);
+
+  py::class_<GazeboServerPool> pool(m, "GazeboServerPool");
+
+  py::class_<GazeboServerPool::Config>(pool, "Config")
+      .def(py::init<>())
+      .def("validate", &GazeboServerPool::Config::Validate)
+      .def_readwrite("server_config", &GazeboServerPool::Config::server_config)
+      .def_readwrite("num_workers", &GazeboServerPool::Config::num_workers)
+      .def_readwrite("joint_names", &GazeboServerPool::Config::joint_names)
+      .def_readwrite("link_names", &GazeboServerPool::Config::link_names)
+      .def_readwrite("base_master_port",
+                     &GazeboServerPool::Config::base_master_port);
+
+  pool.def(py::init<const GazeboServerPool::Config&>())
+      .def("start", &GazeboServerPool::Start)
+      // The workers run in other processes, don't block Python threads
+      // while waiting for them.
+      .def("step", &GazeboServerPool::Step,
+           py::call_guard<py::gil_scoped_release>())
+      .def("run_for", &GazeboServerPool::RunFor, "num_steps"_a,
+           py::call_guard<py::gil_scoped_release>())
+      .def("reset", &GazeboServerPool::Reset,
+           py::call_guard<py::gil_scoped_release>())
+      .def_property_readonly(
+          "commands",
+          [](GazeboServerPool& self) { return self.commands(); },
+          py::return_value_policy::reference_internal,
+          "Joint torques, a (num_workers x num_joints) view on shared "
+          "memory.")
+      .def_property_readonly(
+          "states",
+          [](const GazeboServerPool& self) { return self.states(); },
+          py::return_value_policy::reference_internal,
+          "Robot states, a (num_workers x state_size) view on shared memory.")
+      .def_property_readonly("state_size", &GazeboServerPool::state_size)
+      .def_property_readonly("initialized", &GazeboServerPool::initialized);
 
   m.def("urdf_to_sdf", &UrdfToSdf, "model_urdf_xml"_a);
+
+  py::class_<TrajectoryRecorder>(m, "TrajectoryRecorder")
+      .def_property_readonly("is_open", &TrajectoryRecorder::is_open)
+      .def_property_readonly("path", &TrajectoryRecorder::path)
+      .def_property_readonly("num_columns", &TrajectoryRecorder::num_columns)
+      .def_property_readonly("capacity", &TrajectoryRecorder::capacity)
+      .def_property_readonly("num_rows", &TrajectoryRecorder::num_rows);
+
+  py::class_<StateSample>(m, "StateSample")
+      .def(py::init<>())
+      .def_readonly("index", &StateSample::index)
+      .def_readonly("simulation_time", &StateSample::simulation_time)
+      .def_readonly("data", &StateSample::data);
+
+  py::class_<StateSubscriber>(m, "StateSubscriber")
+      .def(py::init([](const std::string& name) {
+             auto subscriber = std::make_unique<StateSubscriber>();
+             if (!subscriber->Open(name)) {
+               throw std::runtime_error("Failed to open state subscriber!");
+             }
+             return subscriber;
+           }),
+           "name"_a)
+      .def("close", &StateSubscriber::Close)
+      .def(
+          "read_latest",
+          [](const StateSubscriber& self) -> std::optional<StateSample> {
+            StateSample sample;
+            if (!self.ReadLatest(&sample)) return std::nullopt;
+            return sample;
+          })
+      .def(
+          "read",
+          [](const StateSubscriber& self,
+             std::uint64_t index) -> std::optional<StateSample> {
+            StateSample sample;
+            if (!self.Read(index, &sample)) return std::nullopt;
+            return sample;
+          },
+          "index"_a)
+      .def_property_readonly("num_published", &StateSubscriber::num_published)
+      .def_property_readonly("num_slots", &StateSubscriber::num_slots)
+      .def_property_readonly("num_links", &StateSubscriber::num_links)
+      .def_property_readonly("num_joint_axes",
+                             &StateSubscriber::num_joint_axes)
+      .def_property_readonly("link_names", &StateSubscriber::link_names)
+      .def_property_readonly("joint_names", &StateSubscriber::joint_names);
+
+  py::class_<ModelDescription>(m, "ModelDescription")
+      .def_readonly("sdf_xml", &ModelDescription::sdf_xml)
+      .def_readonly("robot_name", &ModelDescription::robot_name);
+
+  m.def(
+      "describe_model",
+      [](const std::string& model_xml) {
+        ModelDescription description;
+        if (!DescribeModel(model_xml, &description)) {
+          throw std::runtime_error("Failed to describe model!");
+        }
+        return description;
+      },
+      "model_xml"_a);
+
+  py::class_<ModelCache>(m, "ModelCache")
+      .def(py::init<const std::string&>(), "directory"_a)
+      .def(
+          "load",
+          [](ModelCache& self, const std::string& model_xml) {
+            ModelDescription description;
+            if (!self.Load(model_xml, &description)) {
+              throw std::runtime_error("Failed to load model!");
+            }
+            return description;
+          },
+          "model_xml"_a)
+      .def("get_entry_path", &ModelCache::GetEntryPath, "model_xml"_a)
+      .def_property_readonly("directory", &ModelCache::directory)
+      .def_property_readonly("num_hits", &ModelCache::num_hits)
+      .def_property_readonly("num_misses", &ModelCache::num_misses);
   m.def("dcm_to_euler_angles", &DcmToEulerAngles, "global_r_local"_a);
   m.def("euler_angles_to_dcm", &EulerAnglesToDcm, "euler_angles"_a);
 }
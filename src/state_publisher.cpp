@@ -0,0 +1,306 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "gazebo_server/state_publisher.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+namespace gazebo_server {
+namespace internal {
+
+constexpr std::uint64_t kPublisherMagic = 0x6762737473746174;
+constexpr std::uint32_t kPublisherVersion = 1;
+constexpr std::size_t kCacheLineSize = 64;
+
+// The shared memory object holds the header, the link and joint names,
+// each terminated by a newline, and the slots, each aligned to a cache line.
+struct PublisherHeader {
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t num_slots;
+  std::uint32_t num_links;
+  std::uint32_t num_joints;
+  std::uint32_t num_joint_axes;
+  std::uint32_t data_size;
+  std::uint64_t names_size;
+  std::uint64_t slots_offset;
+  std::uint64_t slot_stride;
+
+  alignas(kCacheLineSize) std::atomic<std::uint64_t> num_published;
+};
+
+// The sequence of the slot holding the state with index i is 2 * i + 1
+// while the state is written and 2 * i + 2 afterwards.
+struct alignas(kCacheLineSize) PublisherSlot {
+  std::atomic<std::uint64_t> sequence;
+  std::int64_t simulation_time_nsec;
+
+  double* data() { return reinterpret_cast<double*>(this + 1); }
+  const double* data() const {
+    return reinterpret_cast<const double*>(this + 1);
+  }
+};
+
+}  // namespace internal
+
+namespace {
+
+using internal::PublisherHeader;
+using internal::PublisherSlot;
+
+std::size_t RoundUp(std::size_t size) {
+  const auto alignment = internal::kCacheLineSize;
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+bool StatePublisher::Open(const std::string& name, const StateBuffer& buffer,
+                          int num_slots) {
+  Close();
+  if (num_slots <= 0) {
+    std::cerr << "The number of slots must be larger than zero!" << std::endl;
+    return false;
+  }
+
+  std::string names;
+  for (const auto& link_name : buffer.link_names()) {
+    names += link_name + '\n';
+  }
+  for (const auto& joint_name : buffer.joint_names()) {
+    names += joint_name + '\n';
+  }
+  const std::size_t data_size = buffer.data().size();
+  const std::size_t slots_offset =
+      RoundUp(sizeof(PublisherHeader) + names.size());
+  const std::size_t slot_stride =
+      RoundUp(sizeof(PublisherSlot) + data_size * sizeof(double));
+  const std::size_t size = slots_offset + num_slots * slot_stride;
+
+  // Subscribers which mapped a previous object keep it, new ones get the new
+  // one.
+  shm_unlink(name.c_str());
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    std::cerr << "Failed to create shared memory object " << name << "!"
+              << std::endl;
+    return false;
+  }
+  void* memory = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) {
+    std::cerr << "Failed to map shared memory object " << name << "!"
+              << std::endl;
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  // The memory of a new object is zero-initialized.
+  auto header = new (memory) PublisherHeader();
+  header->version = internal::kPublisherVersion;
+  header->num_slots = num_slots;
+  header->num_links = buffer.num_links();
+  header->num_joints = buffer.joint_names().size();
+  header->num_joint_axes = buffer.num_joint_axes();
+  header->data_size = data_size;
+  header->names_size = names.size();
+  header->slots_offset = slots_offset;
+  header->slot_stride = slot_stride;
+  header->num_published.store(0, std::memory_order_relaxed);
+  std::memcpy(static_cast<char*>(memory) + sizeof(PublisherHeader),
+              names.data(), names.size());
+  name_ = name;
+  header_ = header;
+  size_ = size;
+  num_published_ = 0;
+  for (int index = 0; index < num_slots; ++index) {
+    new (slot(index)) PublisherSlot();
+  }
+  // Subscribers check the magic number last.
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = internal::kPublisherMagic;
+  return true;
+}
+
+void StatePublisher::Close() {
+  if (header_ == nullptr) {
+    return;
+  }
+  munmap(header_, size_);
+  shm_unlink(name_.c_str());
+  header_ = nullptr;
+  size_ = 0;
+}
+
+void StatePublisher::Publish(const StateBuffer& buffer) {
+  assert(header_ != nullptr);
+  assert(buffer.data().size() == header_->data_size);
+  auto s = slot(num_published_);
+  const std::uint64_t sequence = 2 * num_published_ + 1;
+  s->sequence.store(sequence, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  s->simulation_time_nsec =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          buffer.simulation_time().time_since_epoch())
+          .count();
+  std::memcpy(s->data(), buffer.data().data(),
+              header_->data_size * sizeof(double));
+  s->sequence.store(sequence + 1, std::memory_order_release);
+  header_->num_published.store(++num_published_, std::memory_order_release);
+}
+
+PublisherSlot* StatePublisher::slot(std::uint64_t index) const {
+  return reinterpret_cast<PublisherSlot*>(
+      reinterpret_cast<char*>(header_) + header_->slots_offset +
+      (index % header_->num_slots) * header_->slot_stride);
+}
+
+bool StateSubscriber::Open(const std::string& name) {
+  Close();
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    std::cerr << "Failed to open shared memory object " << name << "!"
+              << std::endl;
+    return false;
+  }
+  struct stat status;
+  void* memory = MAP_FAILED;
+  if (fstat(fd, &status) == 0 &&
+      static_cast<std::size_t>(status.st_size) >= sizeof(PublisherHeader)) {
+    memory = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) {
+    std::cerr << "Failed to map shared memory object " << name << "!"
+              << std::endl;
+    return false;
+  }
+  header_ = static_cast<const PublisherHeader*>(memory);
+  size_ = status.st_size;
+
+  if (header_->magic != internal::kPublisherMagic ||
+      header_->version != internal::kPublisherVersion ||
+      header_->slots_offset + header_->num_slots * header_->slot_stride >
+          size_) {
+    std::cerr << "Got an invalid or incomplete shared memory object " << name
+              << "!" << std::endl;
+    Close();
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  const char* names =
+      reinterpret_cast<const char*>(header_) + sizeof(PublisherHeader);
+  const char* names_end = names + header_->names_size;
+  std::vector<std::string> all_names;
+  while (names < names_end) {
+    const char* name_end = static_cast<const char*>(
+        std::memchr(names, '\n', names_end - names));
+    if (name_end == nullptr) {
+      break;
+    }
+    all_names.emplace_back(names, name_end);
+    names = name_end + 1;
+  }
+  if (all_names.size() != header_->num_links + header_->num_joints) {
+    std::cerr << "Got invalid names in shared memory object " << name << "!"
+              << std::endl;
+    Close();
+    return false;
+  }
+  link_names_.assign(all_names.begin(),
+                     all_names.begin() + header_->num_links);
+  joint_names_.assign(all_names.begin() + header_->num_links,
+                      all_names.end());
+  return true;
+}
+
+void StateSubscriber::Close() {
+  if (header_ == nullptr) {
+    return;
+  }
+  munmap(const_cast<PublisherHeader*>(header_), size_);
+  header_ = nullptr;
+  size_ = 0;
+  link_names_.clear();
+  joint_names_.clear();
+}
+
+bool StateSubscriber::ReadLatest(StateSample* sample) const {
+  // Reading fails only if the publisher laps the reader, in which case
+  // there is a newer state.
+  for (;;) {
+    const auto num_states = num_published();
+    if (num_states == 0) {
+      return false;
+    }
+    if (Read(num_states - 1, sample)) {
+      return true;
+    }
+  }
+}
+
+bool StateSubscriber::Read(std::uint64_t index, StateSample* sample) const {
+  assert(header_ != nullptr);
+  if (index >= num_published()) {
+    return false;
+  }
+  const auto s = slot(index);
+  const std::uint64_t sequence = 2 * index + 2;
+  if (s->sequence.load(std::memory_order_acquire) != sequence) {
+    return false;
+  }
+  sample->data.resize(header_->data_size);
+  const std::int64_t simulation_time_nsec = s->simulation_time_nsec;
+  std::memcpy(sample->data.data(), s->data(),
+              header_->data_size * sizeof(double));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (s->sequence.load(std::memory_order_relaxed) != sequence) {
+    return false;
+  }
+  sample->index = index;
+  sample->simulation_time = SteadyTimestamp(
+      std::chrono::duration_cast<SteadyClock::duration>(
+          std::chrono::nanoseconds(simulation_time_nsec)));
+  return true;
+}
+
+std::uint64_t StateSubscriber::num_published() const {
+  return header_->num_published.load(std::memory_order_acquire);
+}
+
+int StateSubscriber::num_slots() const { return header_->num_slots; }
+
+int StateSubscriber::num_joint_axes() const {
+  return header_->num_joint_axes;
+}
+
+const PublisherSlot* StateSubscriber::slot(std::uint64_t index) const {
+  return reinterpret_cast<const PublisherSlot*>(
+      reinterpret_cast<const char*>(header_) + header_->slots_offset +
+      (index % header_->num_slots) * header_->slot_stride);
+}
+
+}  // namespace gazebo_server
@@ -0,0 +1,110 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "gazebo_server/step_statistics.h"
+
+#include <cmath>
+
+namespace gazebo_server {
+
+constexpr int LatencyHistogram::kSubBucketBits;
+constexpr int LatencyHistogram::kNumSubBuckets;
+constexpr int LatencyHistogram::kMaxShift;
+constexpr std::uint64_t LatencyHistogram::kMaxValue;
+constexpr int LatencyHistogram::kNumBuckets;
+
+void LatencyHistogram::Clear() {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  min_.store(std::numeric_limits<std::uint64_t>::max(),
+             std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+SteadyClock::duration LatencyHistogram::min() const {
+  if (count() == 0) return SteadyClock::duration(0);
+  return std::chrono::nanoseconds(min_.load(std::memory_order_relaxed));
+}
+
+SteadyClock::duration LatencyHistogram::max() const {
+  return std::chrono::nanoseconds(max_.load(std::memory_order_relaxed));
+}
+
+SteadyClock::duration LatencyHistogram::mean() const {
+  const auto num_values = count();
+  if (num_values == 0) return SteadyClock::duration(0);
+  return std::chrono::nanoseconds(sum_.load(std::memory_order_relaxed) /
+                                  num_values);
+}
+
+SteadyClock::duration LatencyHistogram::total() const {
+  return std::chrono::nanoseconds(sum_.load(std::memory_order_relaxed));
+}
+
+SteadyClock::duration LatencyHistogram::GetPercentile(
+    double percentile) const {
+  const auto num_values = count();
+  if (num_values == 0) return SteadyClock::duration(0);
+  percentile = std::min(std::max(percentile, 0.0), 100.0);
+  const std::uint64_t rank = std::max<std::uint64_t>(
+      1, std::ceil(percentile / 100.0 * num_values));
+
+  std::uint64_t num_seen = 0;
+  for (int index = 0; index < kNumBuckets; ++index) {
+    num_seen += bucket_count(index);
+    if (num_seen >= rank) {
+      return std::chrono::nanoseconds(
+          std::min(GetBucketUpperBound(index),
+                   max_.load(std::memory_order_relaxed)));
+    }
+  }
+  return max();
+}
+
+int LatencyHistogram::GetBucketIndex(std::uint64_t value) {
+  if (value < kNumSubBuckets) {
+    return value;
+  }
+  const int msb = 63 - __builtin_clzll(value);
+  const int shift = msb - kSubBucketBits;
+  return (shift + 1) * kNumSubBuckets + (value >> shift) - kNumSubBuckets;
+}
+
+std::uint64_t LatencyHistogram::GetBucketLowerBound(int index) {
+  if (index < kNumSubBuckets) {
+    return index;
+  }
+  const int shift = index / kNumSubBuckets - 1;
+  return std::uint64_t(kNumSubBuckets + index % kNumSubBuckets) << shift;
+}
+
+std::uint64_t LatencyHistogram::GetBucketUpperBound(int index) {
+  if (index < kNumSubBuckets) {
+    return index;
+  }
+  const int shift = index / kNumSubBuckets - 1;
+  return GetBucketLowerBound(index) + (std::uint64_t{1} << shift) - 1;
+}
+
+void StepStatistics::Clear() {
+  begin_callbacks.Clear();
+  world_update.Clear();
+  physics.Clear();
+  end_callbacks.Clear();
+  step.Clear();
+}
+
+}  // namespace gazebo_server
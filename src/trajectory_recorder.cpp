@@ -0,0 +1,152 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "gazebo_server/trajectory_recorder.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+namespace gazebo_server {
+namespace {
+
+constexpr char kMagic[8] = {'G', 'Z', 'T', 'R', 'A', 'J', '0', '1'};
+constexpr std::uint32_t kVersion = 1;
+// Column data starts at a page boundary.
+constexpr std::size_t kDataAlignment = 4096;
+
+// Byte offsets of header fields.
+constexpr std::size_t kVersionOffset = 8;
+constexpr std::size_t kNumColumnsOffset = 12;
+constexpr std::size_t kCapacityOffset = 16;
+constexpr std::size_t kNumRowsOffset = 24;
+constexpr std::size_t kDataOffsetOffset = 32;
+constexpr std::size_t kNamesSizeOffset = 40;
+constexpr std::size_t kDecimationOffset = 44;
+
+template <typename T>
+void WriteField(char* data, std::size_t offset, T value) {
+  std::memcpy(data + offset, &value, sizeof(value));
+}
+
+}  // namespace
+
+bool TrajectoryRecorder::Open(const std::string& path,
+                              const std::vector<std::string>& column_names,
+                              std::uint64_t capacity, int decimation,
+                              int chunk_size) {
+  Close();
+  if (column_names.empty() || capacity == 0 || decimation <= 0 ||
+      chunk_size <= 0) {
+    std::cerr << "Got an invalid trajectory recorder configuration!"
+              << std::endl;
+    return false;
+  }
+
+  std::string names;
+  for (const auto& name : column_names) {
+    if (name.find('\n') != std::string::npos) {
+      std::cerr << "Got an invalid column name: " << name << "!" << std::endl;
+      return false;
+    }
+    names += name + '\n';
+  }
+  const std::size_t data_offset =
+      (kHeaderSize + names.size() + kDataAlignment - 1) / kDataAlignment *
+      kDataAlignment;
+  const std::size_t size =
+      data_offset + column_names.size() * capacity * sizeof(double);
+
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Failed to create trajectory file " << path << "!"
+              << std::endl;
+    return false;
+  }
+  void* memory = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) {
+    std::cerr << "Failed to map trajectory file " << path << "!" << std::endl;
+    return false;
+  }
+
+  path_ = path;
+  data_ = static_cast<char*>(memory);
+  size_ = size;
+  data_offset_ = data_offset;
+  num_columns_ = column_names.size();
+  capacity_ = capacity;
+  num_rows_ = 0;
+  chunk_.resize(chunk_size, num_columns_);
+  chunk_rows_ = 0;
+
+  std::memcpy(data_, kMagic, sizeof(kMagic));
+  WriteField<std::uint32_t>(data_, kVersionOffset, kVersion);
+  WriteField<std::uint32_t>(data_, kNumColumnsOffset, num_columns_);
+  WriteField<std::uint64_t>(data_, kCapacityOffset, capacity_);
+  WriteField<std::uint64_t>(data_, kNumRowsOffset, 0);
+  WriteField<std::uint64_t>(data_, kDataOffsetOffset, data_offset_);
+  WriteField<std::uint32_t>(data_, kNamesSizeOffset, names.size());
+  WriteField<std::uint32_t>(data_, kDecimationOffset, decimation);
+  std::memcpy(data_ + kHeaderSize, names.data(), names.size());
+  return true;
+}
+
+void TrajectoryRecorder::Close() {
+  if (data_ == nullptr) {
+    return;
+  }
+  Flush();
+  munmap(data_, size_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+bool TrajectoryRecorder::Record(const double* values) {
+  assert(data_ != nullptr);
+  if (num_rows() == capacity_) {
+    return false;
+  }
+  for (int column = 0; column < num_columns_; ++column) {
+    chunk_(chunk_rows_, column) = values[column];
+  }
+  if (++chunk_rows_ == chunk_.rows()) {
+    Flush();
+  }
+  return true;
+}
+
+void TrajectoryRecorder::Flush() {
+  if (data_ == nullptr || chunk_rows_ == 0) {
+    return;
+  }
+  for (int column = 0; column < num_columns_; ++column) {
+    std::memcpy(data_ + data_offset_ +
+                    (column * capacity_ + num_rows_) * sizeof(double),
+                chunk_.col(column).data(), chunk_rows_ * sizeof(double));
+  }
+  num_rows_ += chunk_rows_;
+  chunk_rows_ = 0;
+  std::atomic_thread_fence(std::memory_order_release);
+  WriteField<std::uint64_t>(data_, kNumRowsOffset, num_rows_);
+}
+
+}  // namespace gazebo_server
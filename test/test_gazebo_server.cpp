@@ -11,12 +11,26 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <future>
 #include <memory>
 #include <string>
+#include <thread>
+
+#include <ignition/math/Rand.hh>
 
+#include "gazebo_server/channel_reader.h"
 #include "gazebo_server/gazebo_server.h"
 #include "gazebo_server/helpers.h"
+#include "gazebo_server/model_cache.h"
 
 #include "./test_entry_point.h"
 
@@ -60,9 +74,49 @@ TEST_F(TestGazeboServerConfig, ModelPathFailure) {
   EXPECT_FALSE(config_.Validate());
 }
 
+TEST_F(TestGazeboServerConfig, LockstepPacingFailure) {
+  config_.model_sdf_xml = "foo";
+  config_.lockstep_real_time_factor = -1.0;
+  EXPECT_FALSE(config_.Validate());
+  config_.lockstep_real_time_factor = 1.0;
+  EXPECT_TRUE(config_.Validate());
+  config_.real_time_update_rate = 1000.0;
+  EXPECT_FALSE(config_.Validate());
+  config_.real_time_update_rate = GazeboServer::Config::kAsFastAsPossible;
+  config_.lockstep_max_lag = std::chrono::milliseconds(-1);
+  EXPECT_FALSE(config_.Validate());
+}
+
 class TestGazeboServer : public ::testing::Test {
  public:
   static void SetUpTestCase() {
+    LoadTestConfig();
+
+    server_ = std::make_unique<GazeboServer>(config_);
+    ASSERT_NE(server_, nullptr);
+
+    // Test uninitialized state of the server.
+    ASSERT_FALSE(server_->Step());
+    ASSERT_FALSE(server_->RunFor(
+        2, []() {}, GazeboServer::Callback()));
+    ASSERT_FALSE(server_->Reset());
+    ASSERT_EQ(GetTimestamp(0), server_->GetSimulationTime());
+    ASSERT_EQ(nullptr, server_->GetJoint("right_wheel_hinge"));
+    ASSERT_EQ(nullptr, server_->GetLink("right_wheel"));
+    ASSERT_FALSE(server_->initialized());
+    ASSERT_TRUE(server_->robot_name().empty());
+
+    ASSERT_TRUE(server_->Start());
+  }
+
+  static void TearDownTestCase() { server_.reset(); }
+
+ protected:
+  void SetUp() override { ASSERT_TRUE(server_->Reset()); }
+
+  // Sets config_ to the differential drive robot in the test world.
+  static void LoadTestConfig() {
+    config_ = GazeboServer::Config();
     config_.verbose = true;
 
     const std::string test_data_path(TEST_DATA_PATH);
@@ -81,40 +135,140 @@ class TestGazeboServer : public ::testing::Test {
 
     config_.init_world_p_body = {1, 2, 0};
     config_.init_world_rpy_body = {0, 0, 0};
+  }
 
+  static GazeboServer::Config config_;
+  static std::unique_ptr<GazeboServer> server_;
+};
+
+GazeboServer::Config TestGazeboServer::config_;
+std::unique_ptr<GazeboServer> TestGazeboServer::server_ = nullptr;
+
+// Runs a server with a second robot.
+class TestGazeboServerMultipleRobots : public TestGazeboServer {
+ public:
+  static void SetUpTestCase() {
+    LoadTestConfig();
+    GazeboServer::ModelConfig second_robot;
+    second_robot.sdf_xml = config_.model_sdf_xml;
+    second_robot.name = "differential_drive_2";
+    second_robot.init_world_p_body = {10, 10, 0};
+    config_.additional_models = {second_robot};
     server_ = std::make_unique<GazeboServer>(config_);
-    ASSERT_NE(server_, nullptr);
+    ASSERT_TRUE(server_->Start());
+  }
+};
 
-    // Test uninitialized state of the server.
-    ASSERT_FALSE(server_->Step());
-    ASSERT_FALSE(server_->RunFor(
-        2, []() {}, GazeboServer::Callback()));
-    ASSERT_FALSE(server_->Reset());
-    ASSERT_EQ(GetTimestamp(0), server_->GetSimulationTime());
-    ASSERT_EQ(nullptr, server_->GetJoint("right_wheel_hinge"));
-    ASSERT_EQ(nullptr, server_->GetLink("right_wheel"));
-    ASSERT_FALSE(server_->initialized());
-    ASSERT_TRUE(server_->robot_name().empty());
+// Runs a server paced in lockstep with the steady clock.
+class TestGazeboServerLockstep : public TestGazeboServer {
+ public:
+  static void SetUpTestCase() {
+    LoadTestConfig();
+    config_.lockstep_real_time_factor = 1.0;
+    server_ = std::make_unique<GazeboServer>(config_);
+    ASSERT_TRUE(server_->Start());
+  }
+};
 
+// Runs a server which collects step statistics.
+class TestGazeboServerStepStatistics : public TestGazeboServer {
+ public:
+  static void SetUpTestCase() {
+    LoadTestConfig();
+    config_.collect_step_statistics = true;
+    server_ = std::make_unique<GazeboServer>(config_);
     ASSERT_TRUE(server_->Start());
   }
+};
 
-  static void TearDownTestCase() { server_.reset(); }
+// Runs a server with fast resets. The reference trajectories are recorded
+// after full resets by a server which runs before.
+class TestGazeboServerFastReset : public TestGazeboServer {
+ public:
+  static void SetUpTestCase() {
+    LoadTestConfig();
+    reset_options_.init_world_p_body = Vector3d(-1, -2, 0);
+    reset_options_.init_world_rpy_body = Vector3d(0, 0, 1);
+    reset_options_.seed = 123;
+
+    server_ = std::make_unique<GazeboServer>(config_);
+    ASSERT_TRUE(server_->Start());
+    ASSERT_TRUE(server_->Reset());
+    full_reset_poses_ = RunEpisode();
+    ASSERT_TRUE(server_->Reset(reset_options_));
+    full_reset_options_poses_ = RunEpisode();
+    server_.reset();
+
+    config_.fast_reset = true;
+    server_ = std::make_unique<GazeboServer>(config_);
+    ASSERT_TRUE(server_->Start());
+  }
 
  protected:
-  void SetUp() override { ASSERT_TRUE(server_->Reset()); }
+  struct ChassisPoses {
+    std::vector<Vector3d> world_p_chassis;
+    std::vector<Matrix3d> world_r_chassis;
+  };
 
-  static GazeboServer::Config config_;
-  static std::unique_ptr<GazeboServer> server_;
+  // Drives the robot forward, returns the chassis pose after every step.
+  static ChassisPoses RunEpisode() {
+    static constexpr int kNumSteps = 100;
+    static constexpr double kTorque = 2.0;
+
+    auto left_wheel_hinge = server_->GetJoint("left_wheel_hinge");
+    auto right_wheel_hinge = server_->GetJoint("right_wheel_hinge");
+    auto chassis = server_->GetLink("chassis");
+    ChassisPoses poses;
+    for (int step = 0; step < kNumSteps; ++step) {
+      left_wheel_hinge->SetTorque(kTorque);
+      right_wheel_hinge->SetTorque(kTorque);
+      EXPECT_TRUE(server_->Step());
+
+      Vector3d world_p_chassis;
+      Matrix3d world_r_chassis;
+      chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+      poses.world_p_chassis.push_back(world_p_chassis);
+      poses.world_r_chassis.push_back(world_r_chassis);
+    }
+    return poses;
+  }
+
+  static void ExpectEqual(const ChassisPoses& expected,
+                          const ChassisPoses& actual) {
+    ASSERT_EQ(expected.world_p_chassis.size(), actual.world_p_chassis.size());
+    for (std::size_t step = 0; step < expected.world_p_chassis.size();
+         ++step) {
+      EXPECT_EQ(expected.world_p_chassis[step], actual.world_p_chassis[step])
+          << "step " << step;
+      EXPECT_EQ(expected.world_r_chassis[step], actual.world_r_chassis[step])
+          << "step " << step;
+    }
+  }
+
+  static GazeboServer::ResetOptions reset_options_;
+  static ChassisPoses full_reset_poses_;
+  static ChassisPoses full_reset_options_poses_;
 };
 
-GazeboServer::Config TestGazeboServer::config_;
-std::unique_ptr<GazeboServer> TestGazeboServer::server_ = nullptr;
+GazeboServer::ResetOptions TestGazeboServerFastReset::reset_options_;
+TestGazeboServerFastReset::ChassisPoses
+    TestGazeboServerFastReset::full_reset_poses_;
+TestGazeboServerFastReset::ChassisPoses
+    TestGazeboServerFastReset::full_reset_options_poses_;
 
 TEST_F(TestGazeboServer, Initialized) {
   ASSERT_TRUE(server_->initialized());
   ASSERT_EQ("differential_drive", server_->robot_name());
   ASSERT_EQ(GetTimestamp(0), server_->GetSimulationTime());
+
+  const auto& timings = server_->startup_timings();
+  EXPECT_GT(timings.setup_server.count(), 0);
+  EXPECT_GT(timings.load_world.count(), 0);
+  EXPECT_GT(timings.insert_model.count(), 0);
+  EXPECT_GE(timings.total, timings.setup_server + timings.load_world +
+                               timings.insert_model);
+  EXPECT_GT(timings.num_insertion_steps, 0);
+
   ASSERT_TRUE(server_->Step());
   EXPECT_GT(server_->GetSimulationTime(), GetTimestamp(0));
 
@@ -147,6 +301,36 @@ TEST_F(TestGazeboServer, Initialized) {
   ASSERT_NE(nullptr, server_->GetLink("left_wheel"));
 }
 
+TEST_F(TestGazeboServer, RunForWithDecimation) {
+  static constexpr int kStepNsec = 1000000;  // 1ms.
+  static constexpr int kDecimation = 10;
+
+  std::vector<SteadyTimestamp> begin_times;
+  std::vector<SteadyTimestamp> end_times;
+  const auto on_control_begin = [&begin_times]() {
+    begin_times.push_back(server_->GetSimulationTime());
+  };
+  const auto on_control_end = [&end_times]() {
+    end_times.push_back(server_->GetSimulationTime());
+  };
+  ASSERT_FALSE(server_->RunFor(25, 0, on_control_begin, on_control_end));
+  ASSERT_TRUE(server_->RunFor(25, kDecimation, on_control_begin,
+                              on_control_end));
+  EXPECT_EQ(GetTimestamp(0, 25 * kStepNsec), server_->GetSimulationTime());
+
+  // The last period is incomplete, it doesn't get the end callback.
+  ASSERT_EQ(3u, begin_times.size());
+  ASSERT_EQ(2u, end_times.size());
+  for (int period = 0; period < 3; ++period) {
+    EXPECT_EQ(GetTimestamp(0, (period * kDecimation + 1) * kStepNsec),
+              begin_times[period]);
+  }
+  for (int period = 0; period < 2; ++period) {
+    EXPECT_EQ(GetTimestamp(0, (period + 1) * kDecimation * kStepNsec),
+              end_times[period]);
+  }
+}
+
 TEST_F(TestGazeboServer, SecondServerInstanceFailure) {
   GazeboServer server2(config_);
   EXPECT_FALSE(server2.Start());
@@ -238,6 +422,1028 @@ TEST_F(TestGazeboServer, Repeatability) {
             server_->GetSimulationTime());
 }
 
+TEST_F(TestGazeboServer, SaveAndRestoreState) {
+  auto left_wheel_hinge = server_->GetJoint("left_wheel_hinge");
+  auto right_wheel_hinge = server_->GetJoint("right_wheel_hinge");
+  auto chassis = server_->GetLink("chassis");
+
+  static constexpr int kNumSteps = 50;
+  static constexpr double kTorque = 2.0;
+  static constexpr int kStepNsec = 1000000;  // 1ms.
+
+  const auto run = [&]() {
+    std::vector<Vector3d> world_p_chassis_all;
+    for (int step = 0; step < kNumSteps; ++step) {
+      left_wheel_hinge->SetTorque(kTorque);
+      right_wheel_hinge->SetTorque(-kTorque);
+      EXPECT_TRUE(server_->Step());
+
+      Vector3d world_p_chassis;
+      Matrix3d world_r_chassis;
+      chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+      world_p_chassis_all.push_back(world_p_chassis);
+    }
+    return world_p_chassis_all;
+  };
+
+  StateSnapshot snapshot;
+  ASSERT_TRUE(snapshot.empty());
+  ASSERT_FALSE(server_->RestoreState(snapshot));
+
+  run();
+  ASSERT_TRUE(server_->SaveState(&snapshot));
+  ASSERT_FALSE(snapshot.empty());
+  EXPECT_EQ(GetTimestamp(0, kNumSteps * kStepNsec), snapshot.simulation_time());
+
+  const auto world_p_chassis_1 = run();
+  ASSERT_TRUE(server_->RestoreState(snapshot));
+  EXPECT_EQ(snapshot.simulation_time(), server_->GetSimulationTime());
+  const auto world_p_chassis_2 = run();
+  ASSERT_TRUE(server_->RestoreState(snapshot));
+  const auto world_p_chassis_3 = run();
+
+  for (int step = 0; step < kNumSteps; ++step) {
+    EXPECT_EQ(world_p_chassis_1.at(step), world_p_chassis_2.at(step));
+    EXPECT_EQ(world_p_chassis_1.at(step), world_p_chassis_3.at(step));
+  }
+  EXPECT_EQ(GetTimestamp(0, 2 * kNumSteps * kStepNsec),
+            server_->GetSimulationTime());
+}
+
+TEST_F(TestGazeboServer, SaveStateAndReplay) {
+  auto left_wheel_hinge = server_->GetJoint("left_wheel_hinge");
+  auto right_wheel_hinge = server_->GetJoint("right_wheel_hinge");
+  auto chassis = server_->GetLink("chassis");
+
+  static constexpr int kNumSteps = 50;
+  static constexpr double kTorque = 2.0;
+  // The chassis position and a random number per step.
+  static constexpr int kStepSize = 4;
+
+  StateSnapshot snapshot;
+  const auto run = [&](int first_step, bool save_state) {
+    std::vector<double> trajectory;
+    for (int step = first_step; step < 2 * kNumSteps; ++step) {
+      if (save_state && step == kNumSteps) {
+        EXPECT_TRUE(server_->SaveState(&snapshot));
+      }
+      left_wheel_hinge->SetTorque(kTorque);
+      right_wheel_hinge->SetTorque(-kTorque);
+      EXPECT_TRUE(server_->Step());
+
+      Vector3d world_p_chassis;
+      Matrix3d world_r_chassis;
+      chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+      trajectory.insert(trajectory.end(), world_p_chassis.data(),
+                        world_p_chassis.data() + 3);
+      // Noise models draw from the global generator.
+      trajectory.push_back(ignition::math::Rand::DblUniform());
+    }
+    return trajectory;
+  };
+
+  // Saving a snapshot changes neither the physics nor the random numbers.
+  ASSERT_TRUE(server_->Reset());
+  const auto trajectory = run(0, false);
+  ASSERT_TRUE(server_->Reset());
+  EXPECT_EQ(trajectory, run(0, true));
+
+  // Restoring replays the original run from the snapshot on, random numbers
+  // included.
+  const std::vector<double> second_half(
+      trajectory.begin() + kNumSteps * kStepSize, trajectory.end());
+  for (int restore = 0; restore < 2; ++restore) {
+    ASSERT_TRUE(server_->RestoreState(snapshot));
+    EXPECT_EQ(second_half, run(kNumSteps, false));
+  }
+}
+
+TEST_F(TestGazeboServer, ResetToInitialState) {
+  auto left_wheel_hinge = server_->GetJoint("left_wheel_hinge");
+  auto right_wheel_hinge = server_->GetJoint("right_wheel_hinge");
+  auto chassis = server_->GetLink("chassis");
+
+  static constexpr int kNumSteps = 50;
+  static constexpr double kTorque = 2.0;
+
+  const auto run = [&]() {
+    std::vector<Vector3d> world_p_chassis_all;
+    for (int step = 0; step < kNumSteps; ++step) {
+      left_wheel_hinge->SetTorque(kTorque);
+      right_wheel_hinge->SetTorque(kTorque);
+      EXPECT_TRUE(server_->Step());
+
+      Vector3d world_p_chassis;
+      Matrix3d world_r_chassis;
+      chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+      world_p_chassis_all.push_back(world_p_chassis);
+    }
+    return world_p_chassis_all;
+  };
+
+  // The first run starts from a full reset.
+  const auto world_p_chassis_1 = run();
+  ASSERT_TRUE(server_->ResetToInitialState());
+  EXPECT_EQ(GetTimestamp(0), server_->GetSimulationTime());
+  const auto world_p_chassis_2 = run();
+  ASSERT_TRUE(server_->ResetToInitialState());
+  const auto world_p_chassis_3 = run();
+
+  for (int step = 0; step < kNumSteps; ++step) {
+    EXPECT_EQ(world_p_chassis_1.at(step), world_p_chassis_2.at(step));
+    EXPECT_EQ(world_p_chassis_1.at(step), world_p_chassis_3.at(step));
+  }
+}
+
+TEST_F(TestGazeboServerFastReset, Repeatability) {
+  ASSERT_FALSE(full_reset_poses_.world_p_chassis.empty());
+  ASSERT_FALSE(full_reset_options_poses_.world_p_chassis.empty());
+
+  // Episodes with and without overrides alternate, overrides must not leak
+  // into the next episode.
+  for (int episode = 0; episode < 2; ++episode) {
+    ASSERT_TRUE(server_->Reset());
+    EXPECT_EQ(GetTimestamp(0), server_->GetSimulationTime());
+    ExpectEqual(full_reset_poses_, RunEpisode());
+
+    ASSERT_TRUE(server_->Reset(reset_options_));
+    EXPECT_EQ(GetTimestamp(0), server_->GetSimulationTime());
+    ExpectEqual(full_reset_options_poses_, RunEpisode());
+  }
+
+  // The overridden pose differs from the configured one.
+  EXPECT_NE(full_reset_poses_.world_p_chassis.back(),
+            full_reset_options_poses_.world_p_chassis.back());
+}
+
+TEST_F(TestGazeboServer, ResetOptions) {
+  auto left_wheel_hinge = server_->GetJoint("left_wheel_hinge");
+  auto right_wheel_hinge = server_->GetJoint("right_wheel_hinge");
+  auto chassis = server_->GetLink("chassis");
+  Vector3d world_p_chassis;
+  Matrix3d world_r_chassis;
+
+  GazeboServer::ResetOptions options;
+  options.init_world_p_body = Vector3d(-1, -2, 0);
+  options.init_world_rpy_body = Vector3d(0, 0, 1);
+  options.seed = 123;
+  options.joint_positions["left_wheel_hinge"] = 0.5;
+  ASSERT_TRUE(server_->Reset(options));
+  EXPECT_EQ(GetTimestamp(0), server_->GetSimulationTime());
+  chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+  EXPECT_TRUE(world_p_chassis.isApprox(Vector3d(-1, -2, 0.1), 1e-6));
+  EXPECT_TRUE(world_r_chassis.isApprox(EulerAnglesToDcm({0, 0, 1}), 1e-6));
+  EXPECT_NEAR(0.5, left_wheel_hinge->GetPosition(), 1e-6);
+
+  // Invalid options change nothing.
+  ASSERT_TRUE(server_->Step());
+  GazeboServer::ResetOptions invalid_options;
+  invalid_options.link_masses["chassis"] = 1.0;
+  invalid_options.link_frictions["foo"] = 1.0;
+  ASSERT_FALSE(server_->Reset(invalid_options));
+  invalid_options = GazeboServer::ResetOptions();
+  invalid_options.link_masses["chassis"] = 0.0;
+  ASSERT_FALSE(server_->Reset(invalid_options));
+  invalid_options = GazeboServer::ResetOptions();
+  invalid_options.joint_velocities["bar"] = 0.0;
+  ASSERT_FALSE(server_->Reset(invalid_options));
+  EXPECT_EQ(GetTimestamp(0, 1000000), server_->GetSimulationTime());
+
+  static constexpr int kNumSteps = 200;
+  static constexpr double kTorque = 2.0;
+  const auto run = [&](const GazeboServer::ResetOptions& options) {
+    EXPECT_TRUE(server_->Reset(options));
+    Vector3d world_p_chassis_start;
+    chassis->GetWorldPose(&world_p_chassis_start, &world_r_chassis);
+    for (int step = 0; step < kNumSteps; ++step) {
+      left_wheel_hinge->SetTorque(kTorque);
+      right_wheel_hinge->SetTorque(kTorque);
+      EXPECT_TRUE(server_->Step());
+    }
+    chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+    return Vector3d(world_p_chassis - world_p_chassis_start);
+  };
+
+  const Vector3d nominal_displacement = run(GazeboServer::ResetOptions());
+  ASSERT_GT(nominal_displacement.norm(), 0.0);
+
+  GazeboServer::ResetOptions heavy_options;
+  heavy_options.link_masses["chassis"] = 100.0;
+  EXPECT_NE(nominal_displacement, run(heavy_options));
+
+  GazeboServer::ResetOptions slippery_options;
+  slippery_options.link_frictions["left_wheel"] = 0.0;
+  slippery_options.link_frictions["right_wheel"] = 0.0;
+  EXPECT_LT(run(slippery_options).norm(), 0.5 * nominal_displacement.norm());
+
+  // Overrides last for one episode.
+  EXPECT_EQ(nominal_displacement, run(GazeboServer::ResetOptions()));
+}
+
+TEST_F(TestGazeboServer, ReadState) {
+  StateBuffer buffer;
+  ASSERT_FALSE(server_->ResolveStateBuffer({"chassis", "foo"}, {}, &buffer));
+  ASSERT_FALSE(server_->ResolveStateBuffer({}, {"bar"}, &buffer));
+  ASSERT_TRUE(server_->ResolveStateBuffer(
+      {"chassis", "left_wheel"}, {"left_wheel_hinge", "right_wheel_hinge"},
+      &buffer));
+  ASSERT_EQ(2, buffer.num_links());
+  ASSERT_EQ(2, buffer.num_joint_axes());
+  ASSERT_EQ(2 * StateBuffer::kLinkStateSize +
+                2 * StateBuffer::kJointAxisStateSize,
+            buffer.data().size());
+
+  auto left_wheel_hinge = server_->GetJoint("left_wheel_hinge");
+  auto right_wheel_hinge = server_->GetJoint("right_wheel_hinge");
+  auto chassis = server_->GetLink("chassis");
+  ASSERT_TRUE(server_->RunFor(
+      10,
+      [&]() {
+        left_wheel_hinge->SetTorque(1.0);
+        right_wheel_hinge->SetTorque(2.0);
+      },
+      [&]() { ASSERT_TRUE(server_->ReadState(&buffer)); }));
+
+  EXPECT_EQ(server_->GetSimulationTime(), buffer.simulation_time());
+
+  Vector3d world_p_chassis;
+  Matrix3d world_r_chassis;
+  chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+  EXPECT_EQ(world_p_chassis, buffer.world_p_link().col(0));
+  const Eigen::Quaterniond world_q_chassis(buffer.world_q_link().col(0));
+  EXPECT_TRUE(world_r_chassis.isApprox(world_q_chassis.toRotationMatrix()));
+  EXPECT_EQ(chassis->GetWorldLinearVel(), buffer.world_v_link().col(0));
+  EXPECT_EQ(chassis->GetWorldAngularVel(), buffer.world_w_link().col(0));
+
+  EXPECT_EQ(left_wheel_hinge->GetPosition(), buffer.joint_position()(0));
+  EXPECT_EQ(right_wheel_hinge->GetVelocity(), buffer.joint_velocity()(1));
+  EXPECT_EQ(1.0, buffer.joint_effort()(0));
+  EXPECT_EQ(2.0, buffer.joint_effort()(1));
+
+  ASSERT_TRUE(server_->SetStateBuffer(&buffer));
+  ASSERT_TRUE(server_->Reset());
+  EXPECT_EQ(GetTimestamp(0), buffer.simulation_time());
+  ASSERT_TRUE(server_->Step());
+  EXPECT_EQ(server_->GetSimulationTime(), buffer.simulation_time());
+  chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+  EXPECT_EQ(world_p_chassis, buffer.world_p_link().col(0));
+  ASSERT_TRUE(server_->SetStateBuffer(nullptr));
+}
+
+TEST_F(TestGazeboServer, ChannelReader) {
+  using Reader =
+      ChannelReader<channels::WorldPose, channels::JointVelocity,
+                    channels::WorldLinearVel, channels::JointPosition>;
+  static_assert(Reader::kLinkStateSize == 10);
+  static_assert(Reader::kJointAxisStateSize == 2);
+
+  StateBuffer buffer;
+  ASSERT_TRUE(server_->ResolveStateBuffer(
+      {"chassis", "left_wheel"}, {"left_wheel_hinge", "right_wheel_hinge"},
+      &buffer));
+  Reader reader(buffer);
+  ASSERT_EQ(2, reader.num_links());
+  ASSERT_EQ(2, reader.num_joint_axes());
+  ASSERT_EQ(2 * 10 + 2 * 2, reader.data().size());
+
+  auto left_wheel_hinge = server_->GetJoint("left_wheel_hinge");
+  auto right_wheel_hinge = server_->GetJoint("right_wheel_hinge");
+  ASSERT_TRUE(server_->RunFor(
+      10,
+      [&]() {
+        left_wheel_hinge->SetTorque(1.0);
+        right_wheel_hinge->SetTorque(2.0);
+      },
+      [&]() {
+        ASSERT_TRUE(server_->ReadState(&buffer));
+        reader.Read();
+      }));
+
+  // Channels match those of a state buffer.
+  EXPECT_EQ(buffer.world_p_link(),
+            reader.channel<channels::WorldPose>().topRows<3>());
+  EXPECT_EQ(buffer.world_q_link(),
+            reader.channel<channels::WorldPose>().bottomRows<4>());
+  EXPECT_EQ(buffer.world_v_link(),
+            reader.channel<channels::WorldLinearVel>());
+  EXPECT_EQ(buffer.joint_position().transpose(),
+            reader.channel<channels::JointPosition>());
+  EXPECT_EQ(buffer.joint_velocity().transpose(),
+            reader.channel<channels::JointVelocity>());
+
+  // Channels of a link or a joint axis are contiguous, in the order of
+  // template arguments.
+  EXPECT_EQ(buffer.world_v_link().col(1), reader.links().col(1).tail<3>());
+  EXPECT_EQ(buffer.joint_velocity()(1), reader.joint_axes()(0, 1));
+  EXPECT_EQ(buffer.joint_position()(1), reader.joint_axes()(1, 1));
+  EXPECT_EQ(reader.links().data(), reader.data().data());
+}
+
+TEST_F(TestGazeboServer, CommandBuffer) {
+  CommandBuffer buffer;
+  ASSERT_FALSE(server_->ResolveCommandBuffer({"foo"}, &buffer));
+  ASSERT_TRUE(server_->ResolveCommandBuffer(
+      {"left_wheel_hinge", "right_wheel_hinge"}, &buffer));
+  ASSERT_EQ(2, buffer.num_joint_axes());
+  ASSERT_EQ(Eigen::Vector2d::Zero(), buffer.effort());
+
+  auto left_wheel_hinge = server_->GetJoint("left_wheel_hinge");
+  auto right_wheel_hinge = server_->GetJoint("right_wheel_hinge");
+  auto chassis = server_->GetLink("chassis");
+
+  static constexpr int kNumSteps = 100;
+  static constexpr double kTorque = 2.0;
+
+  std::vector<Vector3d> world_p_chassis_1;
+  for (int step = 0; step < kNumSteps; ++step) {
+    left_wheel_hinge->SetTorque(kTorque);
+    right_wheel_hinge->SetTorque(-kTorque);
+    ASSERT_TRUE(server_->Step());
+    Vector3d world_p_chassis;
+    Matrix3d world_r_chassis;
+    chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+    world_p_chassis_1.push_back(world_p_chassis);
+  }
+
+  ASSERT_TRUE(server_->Reset());
+  buffer.effort() << kTorque, -kTorque;
+  ASSERT_TRUE(server_->SetCommandBuffer(&buffer));
+  std::vector<Vector3d> world_p_chassis_2;
+  ASSERT_TRUE(server_->RunFor(
+      kNumSteps,
+      [&]() {
+        EXPECT_EQ(kTorque, left_wheel_hinge->GetTorque());
+        EXPECT_EQ(-kTorque, right_wheel_hinge->GetTorque());
+      },
+      [&]() {
+        Vector3d world_p_chassis;
+        Matrix3d world_r_chassis;
+        chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+        world_p_chassis_2.push_back(world_p_chassis);
+      }));
+  ASSERT_TRUE(server_->SetCommandBuffer(nullptr));
+
+  ASSERT_EQ(world_p_chassis_1.size(), world_p_chassis_2.size());
+  for (int step = 0; step < kNumSteps; ++step) {
+    EXPECT_EQ(world_p_chassis_1.at(step), world_p_chassis_2.at(step));
+  }
+}
+
+TEST_F(TestGazeboServer, JointControllers) {
+  CommandBuffer buffer;
+  ASSERT_TRUE(server_->ResolveCommandBuffer(
+      {"left_wheel_hinge", "right_wheel_hinge"}, &buffer));
+  EXPECT_EQ(ControlMode::kEffort, buffer.mode(0));
+  EXPECT_EQ(ControlMode::kEffort, buffer.mode(1));
+  EXPECT_TRUE(std::isinf(buffer.effort_limit()(0)));
+
+  auto left_wheel_hinge = server_->GetJoint("left_wheel_hinge");
+  auto right_wheel_hinge = server_->GetJoint("right_wheel_hinge");
+  EXPECT_EQ(1u, left_wheel_hinge->DOF());
+  EXPECT_FALSE(left_wheel_hinge->SetTorque(1.0, 1));
+  EXPECT_FALSE(left_wheel_hinge->SetVelocity(1.0, 1));
+  EXPECT_TRUE(std::isnan(left_wheel_hinge->GetPosition(1)));
+
+  buffer.set_mode(0, ControlMode::kVelocity);
+  buffer.kd()(0) = 10.0;
+  buffer.command()(0) = 2.0;
+  buffer.set_mode(1, ControlMode::kPosition);
+  buffer.kp()(1) = 50.0;
+  buffer.kd()(1) = 5.0;
+  buffer.command()(1) = 1.0;
+  ASSERT_TRUE(server_->SetCommandBuffer(&buffer));
+  ASSERT_TRUE(server_->RunFor(2000, []() {}, GazeboServer::Callback()));
+  EXPECT_NEAR(2.0, left_wheel_hinge->GetVelocity(0), 0.1);
+  EXPECT_NEAR(1.0, right_wheel_hinge->GetPosition(0), 0.05);
+
+  buffer.set_mode(ControlMode::kEffort);
+  buffer.effort_limit().setConstant(0.5);
+  buffer.effort() << 2.0, -2.0;
+  ASSERT_TRUE(server_->Step());
+  EXPECT_EQ(0.5, left_wheel_hinge->GetTorque(0));
+  EXPECT_EQ(-0.5, right_wheel_hinge->GetTorque(0));
+  ASSERT_TRUE(server_->SetCommandBuffer(nullptr));
+}
+
+TEST_F(TestGazeboServer, Rollout) {
+  static constexpr int kNumCommands = 10;
+  static constexpr int kStepsPerCommand = 5;
+  static constexpr int kStepNsec = 1000000;  // 1ms.
+
+  Eigen::MatrixXd joint_commands(kNumCommands, 2);
+  for (int command = 0; command < kNumCommands; ++command) {
+    joint_commands.row(command) << 0.1 * command, -0.2 * command;
+  }
+
+  Trajectory trajectory;
+  ASSERT_FALSE(server_->Rollout(joint_commands, kStepsPerCommand,
+                                &trajectory));
+
+  CommandBuffer commands;
+  StateBuffer state;
+  ASSERT_TRUE(server_->ResolveCommandBuffer(
+      {"left_wheel_hinge", "right_wheel_hinge"}, &commands));
+  ASSERT_TRUE(server_->ResolveStateBuffer(
+      {"chassis"}, {"left_wheel_hinge", "right_wheel_hinge"}, &state));
+  ASSERT_TRUE(server_->SetCommandBuffer(&commands));
+  ASSERT_TRUE(server_->SetStateBuffer(&state));
+
+  ASSERT_FALSE(server_->Rollout(joint_commands, 0, &trajectory));
+  ASSERT_FALSE(server_->Rollout(Eigen::MatrixXd::Zero(kNumCommands, 3),
+                                kStepsPerCommand, &trajectory));
+
+  ASSERT_TRUE(server_->Rollout(joint_commands, kStepsPerCommand,
+                               &trajectory));
+  ASSERT_EQ(kNumCommands, trajectory.states.rows());
+  ASSERT_EQ(state.data().size(), trajectory.states.cols());
+  ASSERT_EQ(kNumCommands, trajectory.simulation_time.size());
+
+  ASSERT_TRUE(server_->Reset());
+  for (int command = 0; command < kNumCommands; ++command) {
+    commands.effort() = joint_commands.row(command).transpose();
+    ASSERT_TRUE(server_->RunFor(kStepsPerCommand, []() {},
+                                GazeboServer::Callback()));
+    EXPECT_EQ(GetTimestamp(0, (command + 1) * kStepsPerCommand * kStepNsec),
+              state.simulation_time());
+    EXPECT_DOUBLE_EQ((command + 1) * kStepsPerCommand * kStepNsec * 1e-9,
+                     trajectory.simulation_time(command));
+    EXPECT_EQ(state.data().transpose(), trajectory.states.row(command));
+  }
+
+  ASSERT_TRUE(server_->SetCommandBuffer(nullptr));
+  ASSERT_TRUE(server_->SetStateBuffer(nullptr));
+}
+
+TEST_F(TestGazeboServer, Hooks) {
+  int num_begin_calls = 0;
+  int num_end_calls = 0;
+  auto on_begin = [&num_begin_calls]() { ++num_begin_calls; };
+  auto on_end = [&num_end_calls]() { ++num_end_calls; };
+
+  ASSERT_EQ(-1, server_->AddHook(GazeboServer::HookPoint::kWorldUpdateBegin,
+                                 FunctionRef()));
+  const int begin_hook_id =
+      server_->AddHook(GazeboServer::HookPoint::kWorldUpdateBegin, on_begin);
+  const int end_hook_id =
+      server_->AddHook(GazeboServer::HookPoint::kWorldUpdateEnd, on_end);
+  ASSERT_GE(begin_hook_id, 0);
+  ASSERT_GE(end_hook_id, 0);
+  ASSERT_NE(begin_hook_id, end_hook_id);
+
+  ASSERT_TRUE(server_->Step());
+  ASSERT_TRUE(server_->RunFor(
+      3, []() {}, GazeboServer::Callback()));
+  ASSERT_TRUE(server_->Reset());
+  ASSERT_TRUE(server_->Step());
+  EXPECT_EQ(5, num_begin_calls);
+  EXPECT_EQ(5, num_end_calls);
+
+  ASSERT_TRUE(server_->RemoveHook(begin_hook_id));
+  ASSERT_FALSE(server_->RemoveHook(begin_hook_id));
+  ASSERT_TRUE(server_->Step());
+  EXPECT_EQ(5, num_begin_calls);
+  EXPECT_EQ(6, num_end_calls);
+  ASSERT_TRUE(server_->RemoveHook(end_hook_id));
+}
+
+TEST_F(TestGazeboServer, EndRun) {
+  static constexpr int kStepNsec = 1000000;  // 1ms.
+
+  int num_steps = 0;
+  ASSERT_TRUE(server_->RunFor(10, []() {}, [&num_steps]() {
+    if (++num_steps == 3) {
+      server_->EndRun();
+    }
+  }));
+  EXPECT_EQ(3, num_steps);
+  EXPECT_EQ(GetTimestamp(0, 3 * kStepNsec), server_->GetSimulationTime());
+
+  // The next call runs all of its steps.
+  ASSERT_TRUE(server_->RunFor(
+      2, []() {}, GazeboServer::Callback()));
+  EXPECT_EQ(GetTimestamp(0, 5 * kStepNsec), server_->GetSimulationTime());
+}
+
+TEST_F(TestGazeboServer, KinematicSetters) {
+  auto chassis = server_->GetLink("chassis");
+  Vector3d world_p_chassis;
+  Matrix3d world_r_chassis;
+
+  const Vector3d world_p_body(3, 4, 0.5);
+  const Matrix3d world_r_body = EulerAnglesToDcm({0, 0, 0.5});
+  ASSERT_TRUE(server_->SetRobotPose(world_p_body, world_r_body));
+  chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+  // The chassis is 0.1 m above the model origin.
+  EXPECT_TRUE(world_p_chassis.isApprox(Vector3d(3, 4, 0.6), 1e-9));
+  EXPECT_TRUE(world_r_chassis.isApprox(world_r_body, 1e-9));
+
+  chassis->SetWorldPose(Vector3d(1, 2, 0.3), Matrix3d::Identity());
+  chassis->GetWorldPose(&world_p_chassis, &world_r_chassis);
+  EXPECT_TRUE(world_p_chassis.isApprox(Vector3d(1, 2, 0.3), 1e-9));
+  EXPECT_TRUE(world_r_chassis.isApprox(Matrix3d::Identity(), 1e-9));
+
+  auto left_wheel_hinge = server_->GetJoint("left_wheel_hinge");
+  left_wheel_hinge->SetPosition(0.5);
+  EXPECT_NEAR(0.5, left_wheel_hinge->GetPosition(), 1e-6);
+}
+
+TEST_F(TestGazeboServerMultipleRobots, LinkAndJointIndices) {
+  const int chassis_index = server_->LinkIndex("chassis");
+  const int chassis_2_index =
+      server_->LinkIndex("differential_drive_2::chassis");
+  ASSERT_GE(chassis_index, 0);
+  ASSERT_GE(chassis_2_index, 0);
+  ASSERT_NE(chassis_index, chassis_2_index);
+  EXPECT_EQ(-1, server_->LinkIndex("foo"));
+  EXPECT_EQ(-1, server_->LinkIndex("differential_drive_2::foo"));
+  EXPECT_EQ("chassis", server_->link_names().at(chassis_index));
+  EXPECT_EQ("differential_drive_2::chassis",
+            server_->link_names().at(chassis_2_index));
+  for (std::size_t index = 0; index < server_->link_names().size(); ++index) {
+    EXPECT_EQ(static_cast<int>(index),
+              server_->LinkIndex(server_->link_names()[index]));
+  }
+
+  const int left_wheel_index = server_->JointIndex("left_wheel_hinge");
+  ASSERT_GE(left_wheel_index, 0);
+  EXPECT_EQ(-1, server_->JointIndex("foo"));
+  EXPECT_EQ("left_wheel_hinge", server_->joint_names().at(left_wheel_index));
+  for (std::size_t index = 0; index < server_->joint_names().size(); ++index) {
+    EXPECT_EQ(static_cast<int>(index),
+              server_->JointIndex(server_->joint_names()[index]));
+  }
+
+  // Views by index refer to the same entities as accessors by name and stay
+  // valid across resets.
+  auto left_wheel = server_->GetJointAt(left_wheel_index);
+  left_wheel.SetTorque(1.5);
+  EXPECT_EQ(1.5, server_->GetJoint("left_wheel_hinge")->GetTorque());
+  const auto chassis_2 = server_->GetLinkAt(chassis_2_index);
+  ASSERT_TRUE(server_->SetRobotPose("differential_drive_2", Vector3d(5, 5, 0),
+                                    Matrix3d::Identity()));
+  Vector3d world_p_chassis;
+  Matrix3d world_r_chassis;
+  chassis_2.GetWorldPose(&world_p_chassis, &world_r_chassis);
+  EXPECT_TRUE(world_p_chassis.isApprox(Vector3d(5, 5, 0.1), 1e-9));
+
+  ASSERT_TRUE(server_->Reset());
+  EXPECT_EQ(chassis_2_index,
+            server_->LinkIndex("differential_drive_2::chassis"));
+  chassis_2.GetWorldPose(&world_p_chassis, &world_r_chassis);
+  EXPECT_TRUE(world_p_chassis.isApprox(Vector3d(10, 10, 0.1), 1e-9));
+}
+
+TEST_F(TestGazeboServerMultipleRobots, MultipleRobots) {
+  ASSERT_EQ(std::vector<std::string>({"differential_drive",
+                                      "differential_drive_2"}),
+            server_->robot_names());
+
+  // Unscoped names refer to the first robot.
+  auto chassis = server_->GetLink("chassis");
+  auto chassis_2 = server_->GetLink("differential_drive_2::chassis");
+  ASSERT_NE(nullptr, chassis_2);
+  ASSERT_NE(chassis.get(), chassis_2.get());
+  ASSERT_EQ(nullptr, server_->GetLink("differential_drive_2::foo"));
+  ASSERT_NE(nullptr,
+            server_->GetJoint("differential_drive_2::left_wheel_hinge"));
+
+  Vector3d world_p_chassis;
+  Matrix3d world_r_chassis;
+  chassis_2->GetWorldPose(&world_p_chassis, &world_r_chassis);
+  EXPECT_TRUE(world_p_chassis.isApprox(Vector3d(10, 10, 0.1), 1e-9));
+
+  StateBuffer buffer;
+  ASSERT_TRUE(server_->ResolveStateBuffer(
+      {"chassis", "differential_drive_2::chassis"}, {}, &buffer));
+  CommandBuffer commands;
+  ASSERT_TRUE(server_->ResolveCommandBuffer(
+      {"differential_drive_2::left_wheel_hinge",
+       "differential_drive_2::right_wheel_hinge"},
+      &commands));
+  commands.effort().setConstant(2.0);
+  ASSERT_TRUE(server_->SetCommandBuffer(&commands));
+  ASSERT_TRUE(server_->RunFor(100, []() {}, GazeboServer::Callback()));
+  ASSERT_TRUE(server_->SetCommandBuffer(nullptr));
+  ASSERT_TRUE(server_->ReadState(&buffer));
+
+  // Only the commanded robot moves.
+  EXPECT_NEAR(1, buffer.world_p_link()(0, 0), 1e-3);
+  EXPECT_NEAR(2, buffer.world_p_link()(1, 0), 1e-3);
+  EXPECT_GT((buffer.world_p_link().col(1) - Vector3d(10, 10, 0.1)).norm(),
+            1e-3);
+
+  ASSERT_TRUE(server_->SetRobotPose("differential_drive_2", Vector3d(5, 5, 0),
+                                    Matrix3d::Identity()));
+  chassis_2->GetWorldPose(&world_p_chassis, &world_r_chassis);
+  EXPECT_TRUE(world_p_chassis.isApprox(Vector3d(5, 5, 0.1), 1e-9));
+  EXPECT_FALSE(server_->SetRobotPose("foo", Vector3d(5, 5, 0),
+                                     Matrix3d::Identity()));
+
+  // A reset puts every robot back to its initial pose.
+  ASSERT_TRUE(server_->Reset());
+  chassis_2->GetWorldPose(&world_p_chassis, &world_r_chassis);
+  EXPECT_TRUE(world_p_chassis.isApprox(Vector3d(10, 10, 0.1), 1e-9));
+}
+
+TEST_F(TestGazeboServer, StatePublisher) {
+  static constexpr char kName[] = "/test_gazebo_server_state";
+  static constexpr int kNumSlots = 4;
+  StateSubscriber subscriber;
+  ASSERT_FALSE(server_->OpenStatePublisher(kName, {"foo"}, {}, kNumSlots));
+  ASSERT_FALSE(subscriber.Open(kName));
+  ASSERT_TRUE(server_->OpenStatePublisher(
+      kName, {"chassis"}, {"left_wheel_hinge", "right_wheel_hinge"},
+      kNumSlots));
+
+  ASSERT_TRUE(subscriber.Open(kName));
+  EXPECT_EQ(kNumSlots, subscriber.num_slots());
+  EXPECT_EQ(std::vector<std::string>({"chassis"}), subscriber.link_names());
+  EXPECT_EQ(
+      std::vector<std::string>({"left_wheel_hinge", "right_wheel_hinge"}),
+      subscriber.joint_names());
+  EXPECT_EQ(2, subscriber.num_joint_axes());
+
+  // The current state is published right away.
+  StateSample sample;
+  EXPECT_EQ(1u, subscriber.num_published());
+  ASSERT_TRUE(subscriber.ReadLatest(&sample));
+  EXPECT_EQ(0u, sample.index);
+  EXPECT_EQ(GetTimestamp(0), sample.simulation_time);
+
+  static constexpr int kNumSteps = 10;
+  ASSERT_TRUE(server_->RunFor(kNumSteps, []() {}, GazeboServer::Callback()));
+  StateBuffer buffer;
+  ASSERT_TRUE(server_->ResolveStateBuffer(
+      {"chassis"}, {"left_wheel_hinge", "right_wheel_hinge"}, &buffer));
+  ASSERT_TRUE(server_->ReadState(&buffer));
+  EXPECT_EQ(kNumSteps + 1u, subscriber.num_published());
+  ASSERT_TRUE(subscriber.ReadLatest(&sample));
+  EXPECT_EQ(static_cast<std::uint64_t>(kNumSteps), sample.index);
+  EXPECT_EQ(buffer.simulation_time(), sample.simulation_time);
+  EXPECT_EQ(buffer.data(), sample.data);
+
+  // Older states are overwritten.
+  ASSERT_TRUE(subscriber.Read(kNumSteps - kNumSlots + 1, &sample));
+  EXPECT_FALSE(subscriber.Read(kNumSteps - kNumSlots, &sample));
+  EXPECT_FALSE(subscriber.Read(kNumSteps + 1, &sample));
+
+  ASSERT_TRUE(server_->CloseStatePublisher());
+  EXPECT_FALSE(StateSubscriber().Open(kName));
+  // Subscribers keep reading the last states.
+  ASSERT_TRUE(subscriber.ReadLatest(&sample));
+  EXPECT_EQ(static_cast<std::uint64_t>(kNumSteps), sample.index);
+}
+
+TEST_F(TestGazeboServer, StartRecording) {
+  char directory[] = "/tmp/test_trajectory_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(directory));
+  const std::string path = std::string(directory) + "/trajectory.bin";
+
+  static constexpr int kCapacity = 5;
+  ASSERT_FALSE(server_->StartRecording(path, {"foo"}, {}, kCapacity));
+  ASSERT_TRUE(server_->StartRecording(path, {"chassis"}, {"left_wheel_hinge"},
+                                      kCapacity, 2));
+  const auto& recorder = server_->recorder();
+  EXPECT_TRUE(recorder.is_open());
+  EXPECT_EQ(1 + StateBuffer::kLinkStateSize + StateBuffer::kJointAxisStateSize,
+            recorder.num_columns());
+  EXPECT_EQ(1u, recorder.num_rows());
+
+  // The initial state and the states after steps 2, 4, 6 and 8 fill the file.
+  ASSERT_TRUE(server_->RunFor(10, []() {}, GazeboServer::Callback()));
+  EXPECT_FALSE(recorder.is_open());
+  EXPECT_EQ(static_cast<std::uint64_t>(kCapacity), recorder.num_rows());
+
+  std::ifstream stream(path, std::ios::binary);
+  std::vector<char> contents((std::istreambuf_iterator<char>(stream)),
+                             std::istreambuf_iterator<char>());
+  ASSERT_GT(contents.size(), TrajectoryRecorder::kHeaderSize);
+  EXPECT_EQ("GZTRAJ01", std::string(contents.data(), 8));
+  std::uint64_t num_rows = 0;
+  std::uint64_t data_offset = 0;
+  std::memcpy(&num_rows, contents.data() + 24, sizeof(num_rows));
+  std::memcpy(&data_offset, contents.data() + 32, sizeof(data_offset));
+  EXPECT_EQ(static_cast<std::uint64_t>(kCapacity), num_rows);
+  const std::string names =
+      "simulation_time\nchassis/world_p_link/x\nchassis/world_p_link/y\n";
+  EXPECT_EQ(names, std::string(contents.data() +
+                                   TrajectoryRecorder::kHeaderSize,
+                               names.size()));
+  ASSERT_EQ(data_offset + recorder.num_columns() * kCapacity * sizeof(double),
+            contents.size());
+  const double* simulation_time =
+      reinterpret_cast<const double*>(contents.data() + data_offset);
+  for (int row = 0; row < kCapacity; ++row) {
+    EXPECT_DOUBLE_EQ(0.002 * row, simulation_time[row]);
+  }
+
+  ASSERT_TRUE(server_->StopRecording());
+  EXPECT_EQ(0, std::remove(path.c_str()));
+  EXPECT_EQ(0, rmdir(directory));
+}
+
+TEST_F(TestGazeboServer, StepAsync) {
+  static constexpr int kNumSteps = 100;
+  static constexpr double kTorque = 2.0;
+
+  CommandBuffer commands;
+  StateBuffer state;
+  ASSERT_TRUE(server_->ResolveCommandBuffer(
+      {"left_wheel_hinge", "right_wheel_hinge"}, &commands));
+  ASSERT_TRUE(server_->ResolveStateBuffer(
+      {"chassis"}, {"left_wheel_hinge", "right_wheel_hinge"}, &state));
+  ASSERT_TRUE(server_->SetCommandBuffer(&commands));
+  ASSERT_TRUE(server_->SetStateBuffer(&state));
+
+  commands.effort() << kTorque, -kTorque;
+  ASSERT_TRUE(server_->RunFor(
+      kNumSteps, []() {}, GazeboServer::Callback()));
+  const Eigen::VectorXd expected_state = state.data();
+  ASSERT_TRUE(server_->Reset());
+
+  // Holds the simulation thread within the first step, such that the server
+  // is guaranteed to be busy.
+  std::atomic<bool> hold{true};
+  auto wait = [&hold]() {
+    while (hold) {
+      std::this_thread::yield();
+    }
+  };
+  const int hook_id =
+      server_->AddHook(GazeboServer::HookPoint::kWorldUpdateBegin, wait);
+  ASSERT_GE(hook_id, 0);
+
+  ASSERT_FALSE(server_->StepAsync(0).get());
+  auto future = server_->StepAsync(kNumSteps);
+  // The efforts were copied on submission.
+  commands.effort().setZero();
+  EXPECT_FALSE(server_->Step());
+  EXPECT_FALSE(server_->Reset());
+  EXPECT_FALSE(server_->SetStateBuffer(nullptr));
+  EXPECT_FALSE(server_->StepAsync(1).get());
+  EXPECT_EQ(std::future_status::timeout,
+            future.wait_for(std::chrono::seconds(0)));
+  EXPECT_EQ(GetTimestamp(0), state.simulation_time());
+  const Eigen::VectorXd initial_state = state.data();
+  hold = false;
+
+  // The state buffer may be read while the simulation is stepping, it's
+  // updated only once the result is collected.
+  while (future.wait_for(std::chrono::seconds(0)) !=
+         std::future_status::ready) {
+    EXPECT_EQ(initial_state, state.data());
+    EXPECT_EQ(GetTimestamp(0), state.simulation_time());
+  }
+  EXPECT_EQ(initial_state, state.data());
+
+  ASSERT_TRUE(future.get());
+  EXPECT_EQ(GetTimestamp(0, 100000000), state.simulation_time());
+  EXPECT_EQ(expected_state, state.data());
+  ASSERT_TRUE(future.get());
+
+  ASSERT_TRUE(server_->RemoveHook(hook_id));
+  ASSERT_TRUE(server_->Step());
+  ASSERT_TRUE(server_->SetCommandBuffer(nullptr));
+  ASSERT_TRUE(server_->SetStateBuffer(nullptr));
+}
+
+TEST(ModelCache, Load) {
+  const std::string test_data_path(TEST_DATA_PATH);
+  std::ifstream stream(test_data_path + "/differential_drive/model.sdf");
+  std::stringstream sstream;
+  sstream << stream.rdbuf();
+  const std::string model_xml = sstream.str();
+
+  // Models are validated only when filling the cache.
+  ModelDescription description;
+  ASSERT_TRUE(DescribeModel(
+      "<sdf version='1.6'><model name='foo'><link/></model></sdf>",
+      &description));
+  EXPECT_EQ("foo", description.robot_name);
+  EXPECT_FALSE(ValidateModel(description));
+
+  char directory[] = "/tmp/test_model_cache_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(directory));
+
+  ModelCache cache(directory);
+  ASSERT_FALSE(cache.Load("<sdf></sdf>", &description));
+  ASSERT_TRUE(cache.Load(model_xml, &description));
+  EXPECT_EQ(0, cache.num_hits());
+  EXPECT_EQ(2, cache.num_misses());
+  EXPECT_EQ("differential_drive", description.robot_name);
+  EXPECT_EQ(model_xml, description.sdf_xml);
+
+  // Another cache on the same directory reads the entry back.
+  ModelDescription cached_description;
+  ModelCache cache2(directory);
+  ASSERT_TRUE(cache2.Load(model_xml, &cached_description));
+  EXPECT_EQ(1, cache2.num_hits());
+  EXPECT_EQ(0, cache2.num_misses());
+  EXPECT_EQ(description.sdf_xml, cached_description.sdf_xml);
+  EXPECT_EQ(description.robot_name, cached_description.robot_name);
+
+  EXPECT_EQ(0, std::remove(cache.GetEntryPath(model_xml).c_str()));
+  EXPECT_EQ(0, rmdir(directory));
+}
+
+TEST(LockstepPacer, Pacing) {
+  using std::chrono::milliseconds;
+  static constexpr int kNumSteps = 20;
+  static constexpr double kRealTimeFactor = 2.0;
+
+  // A large maximum lag keeps a loaded machine from re-anchoring the pacer.
+  LockstepPacer pacer(kRealTimeFactor, std::chrono::microseconds(200),
+                      std::chrono::seconds(1));
+  const auto start_time = SteadyClock::now();
+  pacer.Anchor(GetTimestamp(0));
+  EXPECT_LE(start_time, pacer.GetDeadline(GetTimestamp(0)));
+  EXPECT_EQ(pacer.GetDeadline(GetTimestamp(0)) + milliseconds(500),
+            pacer.GetDeadline(GetTimestamp(1)));
+
+  for (int step = 1; step <= kNumSteps; ++step) {
+    const auto simulation_time = GetTimestamp(0) + milliseconds(step);
+    pacer.WaitUntil(simulation_time);
+    EXPECT_GE(SteadyClock::now(), pacer.GetDeadline(simulation_time));
+  }
+  // Deadlines are absolute, the total duration doesn't depend on sleep
+  // errors of single steps.
+  const auto elapsed_time = SteadyClock::now() - start_time;
+  EXPECT_GE(elapsed_time, milliseconds(kNumSteps) / kRealTimeFactor);
+  EXPECT_LT(elapsed_time, milliseconds(kNumSteps));
+
+  const auto& statistics = pacer.statistics();
+  EXPECT_EQ(kNumSteps, static_cast<int>(statistics.slack.count() +
+                                       statistics.overrun.count()));
+  EXPECT_EQ(0u, statistics.num_reanchors);
+}
+
+TEST(LockstepPacer, Overrun) {
+  using std::chrono::milliseconds;
+  LockstepPacer pacer(1.0, std::chrono::microseconds(200), milliseconds(10));
+  pacer.Anchor(GetTimestamp(0));
+
+  // A small overrun is caught up.
+  std::this_thread::sleep_for(milliseconds(5));
+  pacer.WaitUntil(GetTimestamp(0) + milliseconds(1));
+  EXPECT_EQ(1u, pacer.statistics().overrun.count());
+  EXPECT_EQ(0u, pacer.statistics().num_reanchors);
+
+  // A large overrun re-anchors the pacer.
+  std::this_thread::sleep_for(milliseconds(20));
+  pacer.WaitUntil(GetTimestamp(0) + milliseconds(2));
+  EXPECT_EQ(2u, pacer.statistics().overrun.count());
+  EXPECT_GE(pacer.statistics().overrun.max(), milliseconds(20));
+  EXPECT_EQ(1u, pacer.statistics().num_reanchors);
+  const auto deadline = pacer.GetDeadline(GetTimestamp(0) + milliseconds(3));
+  EXPECT_GT(deadline, SteadyClock::now());
+  EXPECT_LE(deadline, SteadyClock::now() + milliseconds(1));
+
+  pacer.ClearStatistics();
+  EXPECT_EQ(0u, pacer.statistics().overrun.count());
+  EXPECT_EQ(0u, pacer.statistics().num_reanchors);
+}
+
+namespace {
+
+int num_free_function_calls = 0;
+void FreeFunction() { ++num_free_function_calls; }
+
+}  // namespace
+
+TEST(FunctionRef, Callables) {
+  EXPECT_FALSE(FunctionRef());
+  EXPECT_FALSE(FunctionRef(static_cast<void (*)()>(nullptr)));
+
+  int num_calls = 0;
+  auto lambda = [&num_calls]() { ++num_calls; };
+  const auto const_lambda = [&num_calls]() { num_calls += 10; };
+  FunctionRef lambda_ref(lambda);
+  FunctionRef const_lambda_ref(const_lambda);
+  const FunctionRef copy = lambda_ref;
+  lambda_ref();
+  const_lambda_ref();
+  copy();
+  EXPECT_EQ(12, num_calls);
+
+  num_free_function_calls = 0;
+  FunctionRef function_ref(FreeFunction);
+  FunctionRef temporary_ref([]() { ++num_free_function_calls; });
+  ASSERT_TRUE(function_ref);
+  ASSERT_TRUE(temporary_ref);
+  function_ref();
+  temporary_ref();
+  EXPECT_EQ(2, num_free_function_calls);
+}
+
+TEST(LatencyHistogram, Buckets) {
+  for (int index = 0; index < LatencyHistogram::kNumBuckets; ++index) {
+    const auto lower_bound = LatencyHistogram::GetBucketLowerBound(index);
+    const auto upper_bound = LatencyHistogram::GetBucketUpperBound(index);
+    ASSERT_LE(lower_bound, upper_bound);
+    ASSERT_EQ(index, LatencyHistogram::GetBucketIndex(lower_bound));
+    ASSERT_EQ(index, LatencyHistogram::GetBucketIndex(upper_bound));
+    if (index > 0) {
+      ASSERT_EQ(LatencyHistogram::GetBucketUpperBound(index - 1) + 1,
+                lower_bound);
+    }
+  }
+  EXPECT_EQ(LatencyHistogram::kMaxValue,
+            LatencyHistogram::GetBucketUpperBound(
+                LatencyHistogram::kNumBuckets - 1));
+}
+
+TEST(LatencyHistogram, Percentiles) {
+  using std::chrono::microseconds;
+  using std::chrono::nanoseconds;
+
+  LatencyHistogram histogram;
+  EXPECT_EQ(0u, histogram.count());
+  EXPECT_EQ(nanoseconds(0), histogram.GetPercentile(50));
+
+  for (int value = 1; value <= 100; ++value) {
+    histogram.Record(microseconds(value));
+  }
+  EXPECT_EQ(100u, histogram.count());
+  EXPECT_EQ(microseconds(1), histogram.min());
+  EXPECT_EQ(microseconds(100), histogram.max());
+  EXPECT_EQ(nanoseconds(50500), histogram.mean());
+  EXPECT_EQ(microseconds(100), histogram.GetPercentile(100));
+  // Percentiles are accurate up to the relative bucket width.
+  const double kTolerance = 1.0 / LatencyHistogram::kNumSubBuckets;
+  for (double percentile : {1.0, 50.0, 90.0, 99.0}) {
+    const double expected = percentile * 1000.0;
+    const double actual = histogram.GetPercentile(percentile).count();
+    EXPECT_GE(actual, expected);
+    EXPECT_LE(actual, expected * (1.0 + kTolerance));
+  }
+
+  histogram.Record(nanoseconds(-1));
+  EXPECT_EQ(nanoseconds(0), histogram.min());
+
+  histogram.Clear();
+  EXPECT_EQ(0u, histogram.count());
+  EXPECT_EQ(nanoseconds(0), histogram.max());
+}
+
+TEST_F(TestGazeboServerLockstep, StepWithWorkInBetween) {
+  using std::chrono::milliseconds;
+  static constexpr int kNumSteps = 200;
+  // The step size of the test world is 1ms.
+  static constexpr auto kStepDuration = milliseconds(1);
+  static constexpr auto kWorkDuration = std::chrono::microseconds(500);
+
+  // The control loop works for half of every step; deadlines are absolute,
+  // so the work is caught up instead of adding up.
+  const auto start_time = SteadyClock::now();
+  for (int step = 0; step < kNumSteps; ++step) {
+    ASSERT_TRUE(server_->Step());
+    const auto work_end_time = SteadyClock::now() + kWorkDuration;
+    while (SteadyClock::now() < work_end_time) {
+    }
+  }
+  const auto elapsed_time = SteadyClock::now() - start_time;
+  EXPECT_GE(elapsed_time, kNumSteps * kStepDuration);
+  EXPECT_LT(elapsed_time, kNumSteps * (kStepDuration + kWorkDuration / 2));
+  EXPECT_EQ(0u, server_->pacing_statistics().num_reanchors);
+
+  // After a pause, pacing resumes without catching up.
+  std::this_thread::sleep_for(milliseconds(50));
+  ASSERT_TRUE(server_->ResumePacing());
+  server_->ClearPacingStatistics();
+  ASSERT_TRUE(server_->Step());
+  EXPECT_EQ(0u, server_->pacing_statistics().overrun.count());
+}
+
+TEST_F(TestGazeboServerStepStatistics, StepStatistics) {
+  static constexpr int kNumSteps = 10;
+  server_->ClearStepStatistics();
+  const auto& statistics = server_->step_statistics();
+  ASSERT_EQ(0u, statistics.step.count());
+
+  ASSERT_TRUE(server_->Step());
+  ASSERT_TRUE(server_->RunFor(
+      kNumSteps - 1, []() {}, GazeboServer::Callback()));
+
+  for (const auto* histogram :
+       {&statistics.begin_callbacks, &statistics.world_update,
+        &statistics.physics, &statistics.end_callbacks, &statistics.step}) {
+    EXPECT_EQ(kNumSteps, static_cast<int>(histogram->count()));
+  }
+  EXPECT_GT(statistics.step.min().count(), 0);
+  EXPECT_LE(statistics.begin_callbacks.total() +
+                statistics.world_update.total() + statistics.physics.total() +
+                statistics.end_callbacks.total(),
+            statistics.step.total());
+
+  // A slow callback shows up in the begin callbacks.
+  const auto kSleepTime = std::chrono::milliseconds(5);
+  ASSERT_TRUE(server_->RunFor(
+      1, [kSleepTime]() { std::this_thread::sleep_for(kSleepTime); },
+      GazeboServer::Callback()));
+  EXPECT_GE(statistics.begin_callbacks.max(), kSleepTime);
+  EXPECT_GE(statistics.step.GetPercentile(100), kSleepTime);
+}
+
 }  // namespace gazebo_server
 
 TEST_ENTRY_POINT
@@ -16,18 +16,21 @@
 
 import datetime
 import os
+import tempfile
 import unittest
 
 import numpy
 
 from gazebo_server import py_gazebo_server
+from gazebo_server import trajectory_file
 
 
 class ServerWithCallbacks:
 
-  def __init__(self, package_path):
+  def __init__(self, package_path, collect_step_statistics=False):
     config = py_gazebo_server.GazeboServer.Config()
     config.verbose = True
+    config.collect_step_statistics = collect_step_statistics
     config.world_path = os.path.join(package_path, 'test_data',
                                      'empty_test.world')
 
@@ -76,8 +79,14 @@ class TestGazeboServer(unittest.TestCase):
     server = py_gazebo_server.GazeboServer(config)
     self.assertEqual(datetime.timedelta(0), server.simulation_time)
     self.assertTrue(server.start())
+    self.assertGreater(server.startup_timings.total, datetime.timedelta(0))
+    self.assertGreater(server.startup_timings.num_insertion_steps, 0)
     self.assertTrue(server.step())
     self.assertEqual(datetime.timedelta(seconds=0.001), server.simulation_time)
+    # Step statistics and pacing are off by default.
+    self.assertEqual(0, server.step_statistics.step.count)
+    self.assertEqual(0.0, config.lockstep_real_time_factor)
+    self.assertEqual(0, server.pacing_statistics.slack.count)
 
     chassis = server.get_link('chassis')
     world_p_chassis, world_r_chassis = chassis.get_world_pose()
@@ -95,16 +104,206 @@ class TestGazeboServer(unittest.TestCase):
     right_wheel_hinge.set_torque(1.0)
     self.assertEqual(1.0, left_wheel_hinge.get_torque())
     self.assertEqual(1.0, right_wheel_hinge.get_torque())
+    self.assertEqual(1, left_wheel_hinge.dof)
+    with self.assertRaises(IndexError):
+      left_wheel_hinge.set_torque(1.0, axis=1)
+    with self.assertRaises(IndexError):
+      left_wheel_hinge.get_position(axis=1)
 
     with self.assertRaises(RuntimeError):
       server.get_joint('efg')
 
+    chassis_index = server.link_index('chassis')
+    self.assertEqual('chassis', server.link_names[chassis_index])
+    numpy.testing.assert_equal(
+        world_p_chassis,
+        server.get_link_at(chassis_index).get_world_pose()[0])
+    self.assertEqual(-1, server.link_index('abcd'))
+    with self.assertRaises(IndexError):
+      server.get_link_at(len(server.link_names))
+    left_wheel_hinge_index = server.joint_index('left_wheel_hinge')
+    self.assertEqual('left_wheel_hinge',
+                     server.joint_names[left_wheel_hinge_index])
+    self.assertEqual(
+        1.0, server.get_joint_at(left_wheel_hinge_index).get_torque())
+
+    commands = server.resolve_command_buffer(
+        ['left_wheel_hinge', 'right_wheel_hinge'])
+    commands.effort[:] = [0.5, 0.5]
+    self.assertTrue(server.set_command_buffer(commands))
+    self.assertTrue(server.step())
+    self.assertEqual(0.5, left_wheel_hinge.get_torque())
+    self.assertTrue(server.set_command_buffer(None))
+
+    state = server.resolve_state_buffer(['chassis'], ['left_wheel_hinge'])
+    self.assertTrue(server.set_state_buffer(state))
+    world_p_chassis = state.world_p_link
+    joint_position = state.joint_position
+    self.assertEqual((3, 1), world_p_chassis.shape)
+    self.assertEqual((1,), joint_position.shape)
+    self.assertFalse(world_p_chassis.flags.writeable)
+    self.assertTrue(server.step())
+    # The views are refreshed in place.
+    self.assertEqual(server.simulation_time, state.simulation_time)
+    numpy.testing.assert_array_equal(
+        chassis.get_world_pose()[0], world_p_chassis[:, 0])
+    self.assertEqual(left_wheel_hinge.get_position(), joint_position[0])
+    self.assertTrue(server.set_state_buffer(None))
+
+    self.assertFalse(config.fast_reset)
+    self.assertTrue(server.reset_to_initial_state())
+    self.assertEqual(datetime.timedelta(0), server.simulation_time)
+
+    options = py_gazebo_server.GazeboServer.ResetOptions()
+    options.init_world_p_body = [-1, -2, 0]
+    options.seed = 5
+    options.joint_positions = {'left_wheel_hinge': 0.5}
+    options.link_masses = {'chassis': 10.0}
+    self.assertTrue(server.reset(options))
+    numpy.testing.assert_almost_equal([-1, -2, 0.1],
+                                      chassis.get_world_pose()[0], 6)
+    self.assertAlmostEqual(0.5, left_wheel_hinge.get_position(), 6)
+    options.link_frictions = {'foo': 1.0}
+    self.assertFalse(server.reset(options))
+    self.assertTrue(server.reset())
+
+    future = server.step_async(10)
+    self.assertTrue(future.result())
+    self.assertTrue(future.done())
+    self.assertFalse(server.step_async(0).result())
+
+    snapshot = server.save_state()
+    self.assertEqual(server.simulation_time, snapshot.simulation_time)
+    self.assertTrue(server.step())
+    self.assertTrue(server.restore_state(snapshot))
+    self.assertEqual(snapshot.simulation_time, server.simulation_time)
+
+  def test_step_statistics(self):
+    test_server = ServerWithCallbacks(
+        self.package_path, collect_step_statistics=True)
+    server = test_server.server
+    server.clear_step_statistics()
+    self.assertTrue(server.step())
+    step_statistics = server.step_statistics
+    self.assertEqual(1, step_statistics.step.count)
+    self.assertEqual(1, step_statistics.physics.count)
+    self.assertGreater(step_statistics.step.max, datetime.timedelta(0))
+    self.assertLessEqual(step_statistics.physics.max, step_statistics.step.max)
+    self.assertEqual(step_statistics.step.max,
+                     step_statistics.step.get_percentile(50))
+
+  def test_kinematic_mode(self):
+    config = py_gazebo_server.GazeboServer.Config()
+    config.world_path = os.path.join(self.package_path, 'test_data',
+                                     'empty_test.world')
+    model_sdf_path = os.path.join(self.package_path, 'test_data',
+                                  'differential_drive', 'model.sdf')
+    with open(model_sdf_path, 'r') as stream:
+      config.model_sdf_xml = stream.read()
+    config.enable_physics_engine = False
+
+    server = py_gazebo_server.GazeboServer(config)
+    self.assertTrue(server.start())
+    chassis = server.get_link('chassis')
+    left_wheel_hinge = server.get_joint('left_wheel_hinge')
+
+    # Neither gravity nor torques move the robot.
+    world_p_chassis, _ = chassis.get_world_pose()
+    commands = server.resolve_command_buffer(['left_wheel_hinge'])
+    commands.effort[:] = [10.0]
+    self.assertTrue(server.set_command_buffer(commands))
+    server.run_for_without_gil(100)
+    self.assertEqual(datetime.timedelta(seconds=0.1), server.simulation_time)
+    numpy.testing.assert_array_equal(world_p_chassis,
+                                     chassis.get_world_pose()[0])
+    self.assertEqual(0.0, left_wheel_hinge.get_position())
+    self.assertTrue(server.set_command_buffer(None))
+
+    # Poses stay where they are set.
+    world_r_body = py_gazebo_server.euler_angles_to_dcm([0, 0, 1])
+    self.assertTrue(server.set_robot_pose([5, 6, 1], world_r_body))
+    left_wheel_hinge.set_position(0.25)
+    self.assertTrue(server.step())
+    world_p_chassis, world_r_chassis = chassis.get_world_pose()
+    numpy.testing.assert_almost_equal([5, 6, 1.1], world_p_chassis)
+    numpy.testing.assert_almost_equal(world_r_body, world_r_chassis)
+    self.assertAlmostEqual(0.25, left_wheel_hinge.get_position())
+
   def test_run_for(self):
     test_server = ServerWithCallbacks(self.package_path)
     self.assertTrue(test_server.run_for(2))
     self.assertEqual(2, test_server.num_on_world_update_begin_calls)
     self.assertEqual(2, test_server.num_on_world_update_end_calls)
 
+    server = test_server.server
+    self.assertTrue(
+        server.run_for(10, test_server.on_world_update_begin,
+                       test_server.on_world_update_end, decimation=5))
+    self.assertEqual(4, test_server.num_on_world_update_begin_calls)
+    self.assertEqual(4, test_server.num_on_world_update_end_calls)
+    commands = server.resolve_command_buffer(
+        ['left_wheel_hinge', 'right_wheel_hinge'])
+    self.assertTrue(server.set_command_buffer(commands))
+    state = server.resolve_state_buffer(['chassis'], ['left_wheel_hinge'])
+
+    sim_times = []
+
+    def on_callback():
+      sim_times.append(server.simulation_time)
+      commands.effort[:] += 0.1
+
+    states = server.run_for_without_gil(
+        20, callback_period=5, callback=on_callback, state=state)
+    self.assertEqual((20, state.data.size), states.shape)
+    numpy.testing.assert_array_equal(state.data, states[-1, :])
+    self.assertEqual(4, len(sim_times))
+    numpy.testing.assert_almost_equal([0.4, 0.4], commands.effort)
+
+    states = server.run_for_without_gil(3)
+    self.assertEqual((0, 0), states.shape)
+
+    # An error in the callback ends the run right away.
+    def failing_callback():
+      raise ValueError('Failed to compute the commands!')
+
+    start_time = server.simulation_time
+    with self.assertRaises(ValueError):
+      server.run_for_without_gil(
+          1000, callback_period=5, callback=failing_callback)
+    self.assertEqual(datetime.timedelta(seconds=0.005),
+                     server.simulation_time - start_time)
+
+    self.assertTrue(server.set_state_buffer(state))
+    joint_commands = numpy.zeros((10, 2))
+    joint_commands[:, 0] = 1.0
+    trajectory = server.rollout(joint_commands, steps_per_command=2)
+    self.assertEqual((10, state.data.size), trajectory.states.shape)
+    self.assertEqual((10,), trajectory.simulation_time.shape)
+    numpy.testing.assert_array_equal(state.data, trajectory.states[-1, :])
+    self.assertIs(trajectory,
+                  server.rollout(joint_commands, 3, trajectory=trajectory))
+
+    path = os.path.join(tempfile.mkdtemp(), 'trajectory.bin')
+    self.assertTrue(
+        server.start_recording(path, ['chassis'], ['left_wheel_hinge'],
+                               max_num_samples=100, decimation=2))
+    start_time = server.simulation_time.total_seconds()
+    server.run_for_without_gil(10)
+    self.assertEqual(6, server.recorder.num_rows)
+    self.assertTrue(server.stop_recording())
+    recorded = trajectory_file.load_trajectory(path)
+    self.assertEqual(6, len(recorded))
+    self.assertEqual(2, recorded.decimation)
+    self.assertEqual(['simulation_time', 'chassis/world_p_link/x'],
+                     recorded.names[:2])
+    numpy.testing.assert_almost_equal(
+        start_time + 0.002 * numpy.arange(6), recorded['simulation_time'])
+    numpy.testing.assert_array_equal(
+        state.data, recorded.matrix(recorded.names[1:])[-1, :])
+
+    self.assertTrue(server.set_command_buffer(None))
+    self.assertTrue(server.set_state_buffer(None))
+
 
 if __name__ == '__main__':
   unittest.main()
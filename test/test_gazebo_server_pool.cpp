@@ -0,0 +1,270 @@
+// Copyright 2019 Milan Vukov. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gazebo_server/gazebo_server_pool.h"
+
+#include "./test_entry_point.h"
+
+namespace gazebo_server {
+
+class TestGazeboServerPoolConfig : public ::testing::Test {
+ protected:
+  void SetUp() override { config_.server_config.model_sdf_xml = "foo"; }
+
+  GazeboServerPool::Config config_;
+};
+
+TEST_F(TestGazeboServerPoolConfig, Success) {
+  EXPECT_TRUE(config_.Validate());
+}
+
+TEST_F(TestGazeboServerPoolConfig, NumWorkersFailure) {
+  config_.num_workers = 0;
+  EXPECT_FALSE(config_.Validate());
+}
+
+TEST_F(TestGazeboServerPoolConfig, JointNameFailure) {
+  config_.joint_names = {"a", ""};
+  EXPECT_FALSE(config_.Validate());
+}
+
+TEST_F(TestGazeboServerPoolConfig, LinkNameFailure) {
+  config_.link_names = {""};
+  EXPECT_FALSE(config_.Validate());
+}
+
+// Applies the torque params[0] to both wheels and ends an episode after
+// params[1] steps if that is larger than zero. The summary is the
+// displacement of the chassis along the x-axis.
+class WheelTorqueController : public EpisodeController {
+ public:
+  explicit WheelTorqueController(GazeboServer* server)
+      : chassis_(server->GetLink("chassis")) {}
+
+  bool BeginEpisode(const EpisodeSpec& spec) override {
+    torque_ = spec.params[0];
+    num_steps_ = 0;
+    max_num_steps_ = static_cast<int>(spec.params[1]);
+    initial_x_ = GetX();
+    return true;
+  }
+
+  void Control(CommandBuffer* commands) override {
+    commands->effort().setConstant(torque_);
+  }
+
+  bool IsDone() override { return ++num_steps_ == max_num_steps_; }
+
+  void EndEpisode(double* summary) override {
+    summary[0] = GetX() - initial_x_;
+  }
+
+ private:
+  double GetX() const {
+    Eigen::Vector3d world_p_link;
+    Eigen::Matrix3d world_r_link;
+    chassis_->GetWorldPose(&world_p_link, &world_r_link);
+    return world_p_link.x();
+  }
+
+  std::unique_ptr<Link> chassis_;
+  double torque_ = 0;
+  int num_steps_ = 0;
+  int max_num_steps_ = 0;
+  double initial_x_ = 0;
+};
+
+class TestGazeboServerPool : public ::testing::Test {
+ public:
+  static void SetUpTestCase() {
+    const std::string test_data_path(TEST_DATA_PATH);
+    ASSERT_FALSE(test_data_path.empty());
+
+    auto& server_config = config_.server_config;
+    server_config.world_path = test_data_path + "/empty_test.world";
+    {
+      const std::string model_path =
+          test_data_path + "/differential_drive/model.sdf";
+      std::ifstream stream(model_path.c_str());
+      std::stringstream sstream;
+      sstream << stream.rdbuf();
+      server_config.model_sdf_xml = sstream.str();
+    }
+    server_config.init_world_p_body = {1, 2, 0};
+
+    config_.num_workers = kNumWorkers;
+    config_.joint_names = {"left_wheel_hinge", "right_wheel_hinge"};
+    config_.link_names = {"chassis"};
+    config_.episode_controller_factory = [](GazeboServer* server) {
+      return std::make_unique<WheelTorqueController>(server);
+    };
+    config_.num_episode_params = 2;
+    config_.episode_summary_size = 1;
+
+    pool_ = std::make_unique<GazeboServerPool>(config_);
+    ASSERT_NE(pool_, nullptr);
+
+    // Test uninitialized state of the pool.
+    ASSERT_FALSE(pool_->Step());
+    ASSERT_FALSE(pool_->RunFor(2));
+    ASSERT_FALSE(pool_->Reset());
+    ASSERT_FALSE(pool_->Evaluate({}, GazeboServerPool::EpisodeCallback()));
+    ASSERT_EQ(0, pool_->states().size());
+    ASSERT_FALSE(pool_->initialized());
+
+    ASSERT_TRUE(pool_->Start());
+  }
+
+  static void TearDownTestCase() { pool_.reset(); }
+
+ protected:
+  static constexpr int kNumWorkers = 3;
+
+  void SetUp() override {
+    pool_->commands().setZero();
+    ASSERT_TRUE(pool_->Reset());
+  }
+
+  static GazeboServerPool::Config config_;
+  static std::unique_ptr<GazeboServerPool> pool_;
+};
+
+constexpr int TestGazeboServerPool::kNumWorkers;
+GazeboServerPool::Config TestGazeboServerPool::config_;
+std::unique_ptr<GazeboServerPool> TestGazeboServerPool::pool_ = nullptr;
+
+TEST_F(TestGazeboServerPool, Initialized) {
+  ASSERT_TRUE(pool_->initialized());
+  ASSERT_EQ(1 + GazeboServerPool::kLinkStateSize +
+                2 * GazeboServerPool::kJointStateSize,
+            pool_->state_size());
+  ASSERT_EQ(kNumWorkers, pool_->states().rows());
+  ASSERT_EQ(pool_->state_size(), pool_->states().cols());
+  ASSERT_EQ(kNumWorkers, pool_->commands().rows());
+  ASSERT_EQ(2, pool_->commands().cols());
+
+  for (int worker = 0; worker < kNumWorkers; ++worker) {
+    EXPECT_EQ(0, pool_->states()(worker, 0));
+    EXPECT_NEAR(1, pool_->states()(worker, 1), 1e-9);
+    EXPECT_NEAR(2, pool_->states()(worker, 2), 1e-9);
+  }
+
+  ASSERT_TRUE(pool_->Step());
+  ASSERT_TRUE(pool_->RunFor(9));
+  for (int worker = 0; worker < kNumWorkers; ++worker) {
+    EXPECT_DOUBLE_EQ(0.01, pool_->states()(worker, 0));
+  }
+
+  ASSERT_FALSE(pool_->RunFor(0));
+}
+
+TEST_F(TestGazeboServerPool, SameCommandsSameStates) {
+  static constexpr int kNumSteps = 100;
+  pool_->commands().setConstant(2.0);
+  ASSERT_TRUE(pool_->RunFor(kNumSteps));
+  const GazeboServerPool::Matrix states = pool_->states();
+  for (int worker = 1; worker < kNumWorkers; ++worker) {
+    EXPECT_EQ(states.row(0), states.row(worker));
+  }
+}
+
+TEST_F(TestGazeboServerPool, DifferentCommandsDifferentStates) {
+  static constexpr int kNumSteps = 100;
+  pool_->commands().row(0).setConstant(2.0);
+  pool_->commands().row(1).setConstant(-2.0);
+  ASSERT_TRUE(pool_->RunFor(kNumSteps));
+  const GazeboServerPool::Matrix states = pool_->states();
+  // Opposite torques drive the robot in opposite directions along the x-axis.
+  EXPECT_LT((states(0, 1) - 1) * (states(1, 1) - 1), 0);
+  EXPECT_NE(states.row(0), states.row(2));
+}
+
+TEST_F(TestGazeboServerPool, Evaluate) {
+  static constexpr int kNumEpisodes = 3 * kNumWorkers + 1;
+  static constexpr int kNumStepsUntilDone = 20;
+  const std::string trajectory_path =
+      ::testing::TempDir() + "/test_gazebo_server_pool_episode.traj";
+
+  std::vector<EpisodeSpec> specs(kNumEpisodes);
+  for (int episode = 0; episode < kNumEpisodes; ++episode) {
+    auto& spec = specs[episode];
+    spec.init_world_p_body = {static_cast<double>(episode), 2, 0};
+    spec.max_num_steps = 100 + 50 * (episode % 4);
+    spec.params.resize(2);
+    spec.params << (episode % 2 == 0 ? 2.0 : -2.0), 0;
+  }
+  specs[1].params[1] = kNumStepsUntilDone;
+  specs[2].trajectory_path = trajectory_path;
+
+  std::vector<EpisodeResult> results(kNumEpisodes);
+  std::set<int> workers;
+  int num_results = 0;
+  ASSERT_TRUE(pool_->Evaluate(specs, [&](const EpisodeResult& result) {
+    ASSERT_GE(result.episode, 0);
+    ASSERT_LT(result.episode, kNumEpisodes);
+    EXPECT_EQ(-1, results[result.episode].episode);
+    results[result.episode] = result;
+    workers.insert(result.worker);
+    ++num_results;
+  }));
+  ASSERT_EQ(kNumEpisodes, num_results);
+  EXPECT_EQ(static_cast<std::size_t>(kNumWorkers), workers.size());
+
+  for (int episode = 0; episode < kNumEpisodes; ++episode) {
+    const auto& spec = specs[episode];
+    const auto& result = results[episode];
+    ASSERT_TRUE(result.success);
+    const int num_steps =
+        episode == 1 ? kNumStepsUntilDone : spec.max_num_steps;
+    EXPECT_EQ(num_steps, result.num_steps);
+    ASSERT_EQ(pool_->state_size(), result.final_state.size());
+    ASSERT_EQ(1, result.summary.size());
+    EXPECT_DOUBLE_EQ(0.001 * num_steps, result.final_state[0]);
+    EXPECT_NEAR(spec.init_world_p_body.x() + result.summary[0],
+                result.final_state[1], 1e-9);
+    if (episode != 1) {
+      // Opposite torques drive the robot in opposite directions.
+      EXPECT_GT(spec.params[0] * result.summary[0], 0);
+    }
+  }
+
+  // The recording holds the initial state and the state after every step.
+  std::ifstream stream(trajectory_path, std::ios::binary);
+  ASSERT_TRUE(stream.good());
+  std::uint64_t num_rows = 0;
+  stream.seekg(24);
+  stream.read(reinterpret_cast<char*>(&num_rows), sizeof(num_rows));
+  EXPECT_EQ(static_cast<std::uint64_t>(specs[2].max_num_steps + 1), num_rows);
+
+  // Invalid specs fail before any episode runs.
+  specs[0].params.resize(1);
+  num_results = 0;
+  EXPECT_FALSE(pool_->Evaluate(
+      specs, [&num_results](const EpisodeResult&) { ++num_results; }));
+  EXPECT_EQ(0, num_results);
+  specs[0].params.resize(2);
+  specs[0].max_num_steps = 0;
+  EXPECT_FALSE(pool_->Evaluate(specs, GazeboServerPool::EpisodeCallback()));
+}
+
+}  // namespace gazebo_server
+
+TEST_ENTRY_POINT